@@ -3,8 +3,7 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec4 aColor;
 
-uniform mat4 view;
-uniform mat4 projection;
+#include "camera.glsl"
 
 out vec4 particleColor;
 
@@ -13,34 +13,29 @@ void main()
 
 #type fragment
 #version 330 core
+// One direction of a separable gaussian (GaussianBlur.h). Tap 0 is the centre texel, every other tap is mirrored
+// and sits between two texels at the offset where one bilinear fetch returns their weighted sum.
+#define MAX_TAPS 32
+
 out vec4 FragColor;
 
 in vec2 TexCoords;
 
 uniform sampler2D image;
 
-uniform bool horizontal;
-uniform float weight[5] = float[] (0.2270270270, 0.1945945946, 0.1216216216, 0.0540540541, 0.0162162162);
+uniform vec2 direction; // (1, 0) or (0, 1)
+uniform int taps;
+uniform float offsets[MAX_TAPS]; // in texels
+uniform float weights[MAX_TAPS];
 
 void main()
-{             
-     vec2 tex_offset = 1.0 / textureSize(image, 0); // gets size of single texel
-     vec3 result = texture(image, TexCoords).rgb * weight[0];
-     if(horizontal)
-     {
-         for(int i = 1; i < 5; ++i)
-         {
-            result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-            result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-         }
-     }
-     else
-     {
-         for(int i = 1; i < 5; ++i)
-         {
-             result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-             result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-         }
-     }
-     FragColor = vec4(result, 1.0);
+{
+    vec2 step = direction / vec2(textureSize(image, 0));
+    vec3 result = texture(image, TexCoords).rgb * weights[0];
+    for (int i = 1; i < taps; ++i)
+    {
+        result += texture(image, TexCoords + step * offsets[i]).rgb * weights[i];
+        result += texture(image, TexCoords - step * offsets[i]).rgb * weights[i];
+    }
+    FragColor = vec4(result, 1.0);
 }
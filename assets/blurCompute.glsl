@@ -0,0 +1,81 @@
+#type compute
+#version 430 core
+// Both directions of the gaussian (GaussianBlur.h) in one dispatch. A workgroup loads its tile plus an apron of
+// radius texels on every side into shared memory once, blurs the rows of that block horizontally and then the tile
+// vertically out of the first result. The horizontal result is rounded like the fragment path's target: to 8 bits,
+// or with HDR to 11/11/10 bit floats.
+#ifndef HDR
+#define HDR 0
+#endif
+#define TILE 16
+#define MAX_RADIUS 32
+#define BLOCK (TILE + 2 * MAX_RADIUS)
+
+layout (local_size_x = TILE, local_size_y = TILE) in;
+
+uniform sampler2D image;
+
+#if HDR
+layout (r11f_g11f_b10f) uniform writeonly image2D result;
+
+// half floats without the sign and the low mantissa bits, in the target's layout
+uint pack(vec3 color)
+{
+	color = max(color, 0.0);
+	uint r = packHalf2x16(vec2(color.r, 0.0)), g = packHalf2x16(vec2(color.g, 0.0)), b = packHalf2x16(vec2(color.b, 0.0));
+	return ((r >> 4) & 0x7ffu) | (((g >> 4) & 0x7ffu) << 11) | (((b >> 5) & 0x3ffu) << 22);
+}
+
+vec3 unpack(uint bits)
+{
+	return vec3(unpackHalf2x16((bits & 0x7ffu) << 4).x, unpackHalf2x16(((bits >> 11) & 0x7ffu) << 4).x, unpackHalf2x16(((bits >> 22) & 0x3ffu) << 5).x);
+}
+#else
+layout (rgba8) uniform writeonly image2D result;
+
+uint pack(vec3 color) { return packUnorm4x8(vec4(color, 1.0)); }
+vec3 unpack(uint bits) { return unpackUnorm4x8(bits).rgb; }
+#endif
+
+uniform int radius;
+uniform float weights[MAX_RADIUS + 1]; // one side, [0] is the centre texel
+
+// packed to 32 bits, 30 KB together: fits the 32 KB every 4.3 implementation has
+shared uint block[BLOCK * BLOCK]; // (TILE + 2 radius)^2 used, row stride BLOCK
+shared uint horizontal[BLOCK * TILE]; // TILE + 2 radius rows of TILE
+
+void main()
+{
+	const uint THREADS = TILE * TILE;
+	ivec2 size = textureSize(image, 0);
+	ivec2 origin = ivec2(gl_WorkGroupID.xy) * TILE - radius;
+	int span = TILE + 2 * radius;
+
+	for (int i = int(gl_LocalInvocationIndex); i < span * span; i += int(THREADS))
+	{
+		ivec2 local = ivec2(i % span, i / span);
+		ivec2 texel = clamp(origin + local, ivec2(0), size - 1); // GL_CLAMP_TO_EDGE
+		block[local.y * BLOCK + local.x] = pack(texelFetch(image, texel, 0).rgb);
+	}
+	barrier();
+
+	for (int i = int(gl_LocalInvocationIndex); i < span * TILE; i += int(THREADS))
+	{
+		int x = i % TILE, y = i / TILE;
+		int centre = y * BLOCK + x + radius;
+		vec3 sum = unpack(block[centre]) * weights[0];
+		for (int k = 1; k <= radius; ++k)
+			sum += (unpack(block[centre - k]) + unpack(block[centre + k])) * weights[k];
+		horizontal[y * TILE + x] = pack(sum);
+	}
+	barrier();
+
+	ivec2 local = ivec2(gl_LocalInvocationID.xy);
+	ivec2 pixel = ivec2(gl_WorkGroupID.xy) * TILE + local;
+	int centre = (local.y + radius) * TILE + local.x;
+	vec3 sum = unpack(horizontal[centre]) * weights[0];
+	for (int k = 1; k <= radius; ++k)
+		sum += (unpack(horizontal[centre - k * TILE]) + unpack(horizontal[centre + k * TILE])) * weights[k];
+	if (all(lessThan(pixel, size)))
+		imageStore(result, pixel, vec4(sum, 1.0));
+}
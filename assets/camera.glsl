@@ -0,0 +1,6 @@
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec2 viewport; // of the target drawn to, pixels
+};
@@ -0,0 +1,45 @@
+#version 330 core
+// Full-screen pointwise passes (RenderGraph.h). Every stage is switched on by its define and works on the colour of
+// the same texel, so the graph can fold a chain of passes into one draw. With no stage on this is a plain copy.
+#ifndef BLOOM
+#define BLOOM 0
+#endif
+#ifndef TONEMAP
+#define TONEMAP 0 // 1 Reinhard, 2 ACES
+#endif
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+
+#if BLOOM
+uniform sampler2D bloomTexture;
+uniform float bloomFactor;
+#endif
+
+#if TONEMAP
+uniform float exposure;
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 aces(vec3 x)
+{
+	return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+#endif
+
+void main()
+{
+	vec3 color = texture(source, TexCoords).rgb;
+#if BLOOM
+	color += bloomFactor * texture(bloomTexture, TexCoords).rgb; // additive blending
+#endif
+#if TONEMAP == 1
+	color *= exposure;
+	color = color / (1.0 + color);
+#elif TONEMAP == 2
+	color = aces(color * exposure);
+#endif
+	FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,54 @@
+#version 330 core
+// One level of the dual filter (Kawase) bloom chain (DualFilterBloom.h). Downsampling halves the size with 5 taps,
+// upsampling doubles it with 8; the taps sit between texels so every bilinear fetch averages four of them.
+#ifndef UPSAMPLE
+#define UPSAMPLE 0
+#endif
+#ifndef THRESHOLD
+#define THRESHOLD 0
+#endif
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+
+#if THRESHOLD
+uniform float threshold;
+#endif
+
+// only on the first downsample: keeps what is brighter than the threshold, hue preserved
+vec3 bright(vec3 color)
+{
+#if THRESHOLD
+	float brightness = max(color.r, max(color.g, color.b));
+	return color * (max(brightness - threshold, 0.0) / max(brightness, 1e-4));
+#else
+	return color;
+#endif
+}
+
+void main()
+{
+	vec2 texel = 1.0 / vec2(textureSize(source, 0));
+#if UPSAMPLE
+	vec2 halfTexel = 0.5 * texel;
+	vec3 sum = texture(source, TexCoords + vec2(-texel.x, 0.0)).rgb;
+	sum += texture(source, TexCoords + vec2(texel.x, 0.0)).rgb;
+	sum += texture(source, TexCoords + vec2(0.0, -texel.y)).rgb;
+	sum += texture(source, TexCoords + vec2(0.0, texel.y)).rgb;
+	sum += texture(source, TexCoords + vec2(-halfTexel.x, halfTexel.y)).rgb * 2.0;
+	sum += texture(source, TexCoords + vec2(halfTexel.x, halfTexel.y)).rgb * 2.0;
+	sum += texture(source, TexCoords + vec2(halfTexel.x, -halfTexel.y)).rgb * 2.0;
+	sum += texture(source, TexCoords + vec2(-halfTexel.x, -halfTexel.y)).rgb * 2.0;
+	FragColor = vec4(sum / 12.0, 1.0);
+#else
+	vec3 sum = bright(texture(source, TexCoords).rgb) * 4.0;
+	sum += bright(texture(source, TexCoords - texel).rgb);
+	sum += bright(texture(source, TexCoords + texel).rgb);
+	sum += bright(texture(source, TexCoords + vec2(texel.x, -texel.y)).rgb);
+	sum += bright(texture(source, TexCoords - vec2(texel.x, -texel.y)).rgb);
+	FragColor = vec4(sum / 8.0, 1.0);
+#endif
+}
@@ -0,0 +1,78 @@
+#version 330 core
+#include "instanced.glsl"
+
+layout (location = 0) out vec4 FragColor;
+
+in vec4 particleColor;
+#if POINTS
+flat in float pointSize;
+#else
+in vec3 localPosition;
+#endif
+
+uniform float thickness;
+
+#if ANTIALIAS
+// 0 outside, 1 inside, a pixel wide ramp across the edge where `inside` crosses 0
+float coverage(float inside)
+{
+	float width = fwidth(inside);
+	return smoothstep(-width, width, inside);
+}
+#endif
+
+void main()
+{
+#if POINTS
+	// too small to resolve the shape
+	if (pointSize < 2.0)
+	{
+		FragColor = particleColor;
+		return;
+	}
+	// gl_PointCoord runs from the top left corner, the quad's y points up
+	vec3 localPosition = vec3(gl_PointCoord.x * 2.0 - 1.0, 1.0 - gl_PointCoord.y * 2.0, 0.0);
+#endif
+	float x = localPosition.x;
+	float y = localPosition.y;
+	float alpha = 1.0;
+
+#if SHAPE == SHAPE_SQUARE
+	float lowBound = -1 + thickness;
+	float highBound = 1 - thickness;
+#if ANTIALIAS
+	alpha = coverage(max(abs(x), abs(y)) - highBound);
+#else
+	if (x > lowBound && x < highBound && y > lowBound && y < highBound)
+		discard;
+#endif
+
+#elif SHAPE == SHAPE_CIRCLE
+	float length = length(localPosition);
+#if ANTIALIAS
+	alpha = coverage(length - (1 - thickness)) * coverage(1.0 - length);
+#else
+	if (length < (1 - thickness) || length > 1.0)
+		discard;
+#endif
+
+#else // SHAPE_TRIANGLE
+	float x1 = (y - 1.0) / 2.0; // point on left line
+	float x2 = (y - 1.0) / -2.0; // point on right line
+#if ANTIALIAS
+	alpha = coverage(x2 - abs(x));
+#else
+	float d1 = x1 - x;
+	float d2 = x2 - x;
+
+	if (d1 * d2 > 0) // if both have same sign
+		discard;
+#endif
+#endif
+
+#if ANTIALIAS
+	if (alpha <= 0.0)
+		discard;
+#endif
+	FragColor = vec4(particleColor.rgb, particleColor.a * alpha);
+}
@@ -0,0 +1,22 @@
+// variant values of the instanced particle shaders, see InstancedParticleSystem
+#define SHAPE_SQUARE 0
+#define SHAPE_CIRCLE 1
+#define SHAPE_TRIANGLE 2
+
+#define INSTANCE_COMPACT 0
+#define INSTANCE_MATRIX 1
+
+// POINTS: one GL_POINTS vertex per particle instead of an instanced quad, compact instances only
+
+#ifndef SHAPE
+#define SHAPE SHAPE_SQUARE
+#endif
+#ifndef ANTIALIAS
+#define ANTIALIAS 0
+#endif
+#ifndef INSTANCE_FORMAT
+#define INSTANCE_FORMAT INSTANCE_COMPACT
+#endif
+#ifndef POINTS
+#define POINTS 0
+#endif
@@ -1,17 +1,41 @@
 #version 330 core
+#include "instanced.glsl"
+#include "camera.glsl"
+
+#if !POINTS
 layout (location = 0) in vec3 aPos;
+#endif
 layout (location = 1) in vec4 instanceColor;
+#if INSTANCE_FORMAT == INSTANCE_MATRIX
 layout (location = 2) in mat4 instanceModel;
-
-uniform mat4 view;
-uniform mat4 projection;
+#else
+layout (location = 2) in vec4 instancePositionScale; // xyz position, w scale
+#endif
 
 out vec4 particleColor;
+#if POINTS
+flat out float pointSize; // before the clamp to a pixel
+#else
 out vec3 localPosition;
+#endif
 
 void main()
 {
+#if POINTS
+	gl_Position = projection * view * vec4(instancePositionScale.xyz, 1.0f);
+	// as wide as the quad (2 * scale) would be, the point's corners are its local position in the fragment shader
+	pointSize = instancePositionScale.w * projection[1][1] * viewport.y / gl_Position.w;
+	gl_PointSize = max(pointSize, 1.0);
+#elif INSTANCE_FORMAT == INSTANCE_MATRIX
 	gl_Position = projection * view * instanceModel * vec4(aPos, 1.0f);
+#else
+	gl_Position = projection * view * vec4(aPos * instancePositionScale.w + instancePositionScale.xyz, 1.0f);
+#endif
 	particleColor = instanceColor;
+#if POINTS
+	// a quad smaller than a pixel lands on that fraction of the pixels on average, a point always on one
+	particleColor.a *= min(pointSize * pointSize, 1.0);
+#else
 	localPosition = aPos;
+#endif
 }
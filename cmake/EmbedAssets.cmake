@@ -0,0 +1,41 @@
+# Packs every file of ASSETS_DIR into OUTPUT, a header with one array per file and the sorted index
+# assets::EMBEDDED that src/AssetPack.h looks names up in.
+#
+# cmake -DASSETS_DIR=<dir> -DOUTPUT=<header> -P EmbedAssets.cmake
+
+if(NOT ASSETS_DIR OR NOT OUTPUT)
+    message(FATAL_ERROR "usage: cmake -DASSETS_DIR=<dir> -DOUTPUT=<header> -P EmbedAssets.cmake")
+endif()
+
+file(GLOB ASSET_NAMES LIST_DIRECTORIES false RELATIVE "${ASSETS_DIR}" "${ASSETS_DIR}/*")
+list(SORT ASSET_NAMES)
+if(NOT ASSET_NAMES)
+    message(FATAL_ERROR "No assets in ${ASSETS_DIR}")
+endif()
+
+string(REPEAT "0x[0-9a-f][0-9a-f], " 16 LINE_PATTERN)
+
+set(ARRAYS "")
+set(INDEX "")
+set(ASSET_INDEX 0)
+foreach(NAME IN LISTS ASSET_NAMES)
+    file(READ "${ASSETS_DIR}/${NAME}" HEX HEX)
+    string(LENGTH "${HEX}" HEX_LENGTH)
+    math(EXPR SIZE "${HEX_LENGTH} / 2")
+
+    # 0x.., 16 bytes per line; a trailing 0 so text assets can also be used as C strings
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1, " BYTES "${HEX}")
+    string(REGEX REPLACE "(${LINE_PATTERN})" "\\1\n\t\t" BYTES "${BYTES}")
+    string(REPLACE ", \n" ",\n" BYTES "${BYTES}")
+
+    string(APPEND ARRAYS "\t// ${NAME}\n\tconst unsigned char ASSET_${ASSET_INDEX}[] = {\n\t\t${BYTES}0x00\n\t};\n\n")
+    string(APPEND INDEX "\t\t{ \"${NAME}\", { reinterpret_cast<const char*>(ASSET_${ASSET_INDEX}), ${SIZE} } },\n")
+    math(EXPR ASSET_INDEX "${ASSET_INDEX} + 1")
+endforeach()
+
+set(CONTENT "// generated by cmake/EmbedAssets.cmake from ${ASSETS_DIR}, do not edit\n#pragma once\n\nnamespace assets\n{\n${ARRAYS}\t// sorted by name\n\tconst Entry EMBEDDED[] = {\n${INDEX}\t};\n}\n")
+
+# only touch the header when an asset changed, everything including it is rebuilt otherwise
+file(WRITE "${OUTPUT}.tmp" "${CONTENT}")
+file(COPY_FILE "${OUTPUT}.tmp" "${OUTPUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${OUTPUT}.tmp")
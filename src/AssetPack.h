@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace assets
+{
+	struct Entry
+	{
+		std::string_view name;
+		std::string_view data;
+	};
+}
+
+#ifdef PARTICLES_EMBEDDED_ASSETS
+#include "EmbeddedAssets.h" // generated from assets/ by cmake/EmbedAssets.cmake
+#endif
+
+// Shaders and the other files of assets/. Builds with the embedded pack carry them inside the executable and hand out
+// views into it, nothing is looked up on disk. Setting a loose directory (--assets DIR or PARTICLES_ASSETS) reads
+// the files instead, which is what shader hot reload needs.
+namespace assets
+{
+	std::optional<std::filesystem::path>& looseDirectory()
+	{
+		static auto directory = []() -> std::optional<std::filesystem::path>
+		{
+			const auto* environment = std::getenv("PARTICLES_ASSETS");
+			if (environment && *environment)
+				return std::filesystem::path(environment);
+			return std::nullopt;
+		}();
+		return directory;
+	}
+
+	// contents of `name` inside the executable, nothing when it is not in the pack
+	std::optional<std::string_view> embedded(std::string_view name)
+	{
+#ifdef PARTICLES_EMBEDDED_ASSETS
+		const auto entry = std::lower_bound(std::begin(EMBEDDED), std::end(EMBEDDED), name, [](const Entry& entry, std::string_view name) { return entry.name < name; });
+		if (entry != std::end(EMBEDDED) && entry->name == name)
+			return entry->data;
+#endif
+		return std::nullopt;
+	}
+
+	std::size_t embeddedCount()
+	{
+#ifdef PARTICLES_EMBEDDED_ASSETS
+		return std::size(EMBEDDED);
+#else
+		return 0;
+#endif
+	}
+
+	// Where `path` is read from. Paths with a directory stay as they are; a bare asset name goes to the loose
+	// directory when one is set, then to the pack, then to the first assets/ found above the working directory.
+	std::filesystem::path resolve(const std::filesystem::path& path)
+	{
+		if (path.has_parent_path())
+			return path;
+
+		if (const auto& directory = looseDirectory())
+			return *directory / path;
+
+		if (embedded(path.string()))
+			return path;
+
+		// move from {root}/build/Release to {root}/assets on Windows
+		// TODO build list for possible paths
+		if (std::filesystem::exists("../../assets"))
+			return std::filesystem::path("../../assets") / path;
+		if (std::filesystem::exists("../assets"))
+			return std::filesystem::path("../assets") / path;
+
+		throw std::runtime_error("Could not open file:" + path.string());
+	}
+
+	// Contents of a resolved path. Embedded assets are a view into the executable, files are read into `storage`
+	// and the view points there.
+	std::string_view read(const std::filesystem::path& path, std::string& storage)
+	{
+		if (!path.has_parent_path())
+		{
+			if (const auto data = embedded(path.string()))
+				return *data;
+		}
+
+		auto file = std::ifstream(path, std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file:" + path.string());
+
+		storage.resize(static_cast<std::size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(storage.data(), storage.size());
+		return storage;
+	}
+}
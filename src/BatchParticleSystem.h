@@ -2,7 +2,11 @@
 
 #include "OpenGLUtils.h"
 #include "Shader.h"
-#include "Timer.h"
+#include "GLState.h"
+#include "GLObjects.h"
+#include "Profiler.h"
+#include "Random.h"
+#include "ParticleProperties.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtx/compatibility.hpp>
@@ -14,18 +18,6 @@
 #include <random>
 #include <iostream>
 
-namespace rng
-{
-	auto Float()
-	{
-		static std::random_device rd{};
-		static auto seed = std::mt19937{ rd() };
-		static auto distribution = std::uniform_real_distribution<float>(-0.002f, 0.002f);
-
-		return distribution(seed);
-	}
-}
-
 class BatchParticleSystem final
 {
 	struct Vertex
@@ -48,37 +40,24 @@ class BatchParticleSystem final
 		bool isAlive = false;
 	};
 
-	const GLuint VAO, VBO, EBO, textureId, FBO;
-	const Shader shader;
+	const gl::VertexArray VAO;
+	const gl::Buffer VBO, EBO;
+	Shader shader;
 
 	std::list<Particle> aliveParticles;
 
-	struct
-	{
-		glm::vec3 initialVelocity = { 0.f, 0.f, 0.f };
-		glm::vec3 acceleration = { 0.f, 0.f, 0.f };
-		glm::vec4 startColor = { 0.f, 0.5f, 1.f, 1.f };
-		glm::vec4 endColor = { 1.f, 0.f, 0.f, 1.f };
-		int totalLifetimeSeconds = 5;
-		int spawnCount = 50;
-		float scale = 0.0025f;
-		int particleShape = 1; // 0 - square, 1 - circle // TODO enum or sth (fast impl for imgui exposure)...
-		float shapeThickness = 0.8f;
-		bool randomVelocity = true;
-		bool randomAcceleration = false;
-	} properties;
+	ParticleProperties properties;
 
 	const std::size_t particlesLimit;
 
 	std::vector<Vertex> vertices;
+	std::size_t verticesCount = 0;
 
 public:
-	BatchParticleSystem(unsigned int poolCount, unsigned int width, unsigned int height)
+	explicit BatchParticleSystem(unsigned int poolCount)
 		: VAO(gl::genVertexArray())
 		, VBO(gl::genBuffer())
 		, EBO(gl::genBuffer())
-		, textureId(gl::genTexture(width, height))
-		, FBO(gl::genFramebuffer(textureId))
 		, shader("batchParticleSystem.glsl")
 		, particlesLimit(poolCount)
 	{
@@ -116,6 +95,9 @@ public:
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
 	}
 
 	auto& startColor() { return properties.startColor; }
@@ -130,8 +112,7 @@ public:
 	auto& acceleration() { return properties.acceleration; }
 	auto& randomVelocity() { return properties.randomVelocity; }
 	auto& randomAcceleration() { return properties.randomAcceleration; }
-
-	auto texture() { return textureId; }
+	auto& props() { return properties; }
 
 
 	// TODO this seems to be slower than fillQuads; read doc for emplace_back
@@ -179,17 +160,25 @@ public:
 		vBottomLeft.color = vBottomRight.color = vTopRight.color = vTopLeft.color = color;
 	}
 
-	void draw(glm::mat4 view, glm::mat4 projection, float currentTime)
+	// view/projection come from the Camera uniform block (CameraBuffer)
+	void draw(float currentTime, GLuint framebuffer)
 	{
-		if (aliveParticles.empty())
-			return;
+		// draws the particles where they were before this frame's step
+		fill(currentTime);
+		update(currentTime);
+		upload();
+		render(framebuffer);
+	}
+
+	// stages of draw() exposed separately so they can be measured on their own
+	void update(float currentTime)
+	{
+		PROFILE_CPU_SCOPE("particles update");
 
 		const auto totalLifetimeSeconds = properties.totalLifetimeSeconds;
 
-		auto vertexIndex = 0u;
-		for (auto particleIt = aliveParticles.rbegin(); particleIt != aliveParticles.rend(); particleIt++)
+		for (auto& particle : aliveParticles)
 		{
-			auto& particle = *particleIt;
 			const auto particleLifetime = currentTime - particle.creationTime;
 			if (particleLifetime > totalLifetimeSeconds)
 			{
@@ -198,47 +187,71 @@ public:
 
 			if (particle.isAlive)
 			{
-				const auto progress = particleLifetime / float(totalLifetimeSeconds);
-				const auto color = glm::lerp(particle.startColor, particle.endColor, progress);
-				//addQuads(particle.position, particle.rotationSpeed * progress, particle.scale, color, vertices);
-				auto& bottomLeft = vertices[vertexIndex++];
-				auto& bottomRight = vertices[vertexIndex++];
-				auto& topRight = vertices[vertexIndex++];
-				auto& topLeft = vertices[vertexIndex++];
-				fillQuad(particle.position, particle.rotationSpeed * progress, particle.scale, color, bottomLeft, bottomRight, topRight, topLeft);
 				particle.position += particle.velocity;
 				particle.velocity += particle.acceleration;
 			}
 		}
 
 		aliveParticles.remove_if([](const auto& p) { return !p.isAlive; });
+	}
 
-		shader.use();
-		shader.setMat4("view", view);
-		shader.setMat4("projection", projection);
+	void fill(float currentTime)
+	{
+		PROFILE_CPU_SCOPE("particles fill");
 
-		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-		gl::checkError();
+		const auto totalLifetimeSeconds = properties.totalLifetimeSeconds;
 
-		glClearColor(0.f, 0.f, 0.f, 0.f);
-		gl::checkError();
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		gl::checkError();
+		verticesCount = 0;
+		for (auto particleIt = aliveParticles.rbegin(); particleIt != aliveParticles.rend(); particleIt++)
+		{
+			const auto& particle = *particleIt;
+			const auto particleLifetime = currentTime - particle.creationTime;
+			if (particleLifetime > totalLifetimeSeconds)
+				continue; // update() drops it this frame
+			const auto progress = particleLifetime / float(totalLifetimeSeconds);
+			const auto color = glm::lerp(particle.startColor, particle.endColor, progress);
+			//addQuads(particle.position, particle.rotationSpeed * progress, particle.scale, color, vertices);
+			auto& bottomLeft = vertices[verticesCount++];
+			auto& bottomRight = vertices[verticesCount++];
+			auto& topRight = vertices[verticesCount++];
+			auto& topLeft = vertices[verticesCount++];
+			fillQuad(particle.position, particle.rotationSpeed * progress, particle.scale, color, bottomLeft, bottomRight, topRight, topLeft);
+		}
+	}
+
+	void upload()
+	{
+		PROFILE_SCOPE("particles upload");
+
+		if (verticesCount == 0)
+			return;
 
-		const auto verticesDataSize = sizeof(Vertex) * vertexIndex;
+		const auto verticesDataSize = sizeof(Vertex) * verticesCount;
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		gl::checkError();
 		glBufferSubData(GL_ARRAY_BUFFER, 0, verticesDataSize, vertices.data());
 		gl::checkError();
+	}
 
-		const auto indicesCount = (vertexIndex / 4) * 6;
-		glBindVertexArray(VAO);
+	void render(GLuint framebuffer)
+	{
+		PROFILE_SCOPE("particles render");
+
+		shader.use();
+
+		gl::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glClearColor(0.f, 0.f, 0.f, 0.f);
 		gl::checkError();
-		glDrawElements(GL_TRIANGLES, indicesCount, GL_UNSIGNED_INT, 0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		gl::checkError();
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		gl::checkError();
+		if (verticesCount != 0)
+		{
+			const auto indicesCount = (verticesCount / 4) * 6;
+			gl::bindVertexArray(VAO);
+			glDrawElements(GL_TRIANGLES, indicesCount, GL_UNSIGNED_INT, 0);
+			gl::checkError();
+		}
 	}
 
 	void emit(glm::vec3 worldPos, float t)
@@ -280,14 +293,4 @@ public:
 			aliveParticles.push_back(particle);
 		}
 	}
-
-	void resize(unsigned int width, unsigned int height)
-	{
-		glBindTexture(GL_TEXTURE_2D, textureId);
-		gl::checkError();
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-		gl::checkError();
-		glBindTexture(GL_TEXTURE_2D, textureId);
-		gl::checkError();
-	}
 };
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Shader.h"
+#include "OpenGLUtils.h"
+#include "GLObjects.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// view/projection (and the viewport size) shared by all particle programs through the std140 "Camera" uniform block,
+// uploaded and bound once per frame instead of set on every program
+class CameraBuffer final
+{
+	struct Block
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec2 viewport;
+		glm::vec2 padding; // std140 rounds the block up to a multiple of 16 bytes
+	};
+	static_assert(sizeof(Block) % 16 == 0, "smaller than the std140 block");
+
+	const gl::Buffer UBO;
+
+public:
+	CameraBuffer()
+		: UBO(gl::genBuffer())
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO); gl::checkError();
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW); gl::checkError();
+		glBindBuffer(GL_UNIFORM_BUFFER, 0); gl::checkError();
+	}
+
+	void update(const glm::mat4& view, const glm::mat4& projection, glm::vec2 viewport)
+	{
+		const auto block = Block{ view, projection, viewport, {} };
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO); gl::checkError();
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block); gl::checkError();
+		glBindBuffer(GL_UNIFORM_BUFFER, 0); gl::checkError();
+		glBindBufferBase(GL_UNIFORM_BUFFER, gl::CAMERA_BLOCK, UBO); gl::checkError();
+		gl::counters().bufferUpload++;
+	}
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "OpenGLUtils.h"
+#include "GLState.h"
+#include "GLDebug.h"
+#include "RenderTargets.h"
+#include "RenderGraph.h"
+#include "TexturedQuad.h"
+#include "ShaderVariants.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <vector>
+
+// Blurs on a mip chain instead of at full resolution: each level downsamples the previous one to half its size,
+// then the chain is upsampled back to half resolution, where the composite's bilinear fetch takes over. Levels 1..n
+// are 1/2 .. 1/2^n of the full size, so the cost stays below 1/3 of a single full resolution pass whatever the
+// radius. The bloom factor is applied by the composite as for the gaussian blur.
+class DualFilterBloom final
+{
+	const TexturedQuad& quad;
+	ShaderVariants shader;
+	std::vector<gl::RenderTargetPool::Lease> chain;
+	int _levels = 3; // half, quarter, eighth
+	float _threshold = 0.f;
+
+	static gl::RenderTargetDesc levelDesc(const gl::RenderTargetPool& targets, int level, GLenum format)
+	{
+		return { std::max(targets.width() >> level, 1u), std::max(targets.height() >> level, 1u), format, GL_LINEAR };
+	}
+
+	void pass(Shader& shader, GLuint source, GLuint framebuffer, const gl::RenderTargetDesc& desc)
+	{
+		PROFILE_GPU_SCOPE("dual filter level");
+		shader.use();
+		gl::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, desc.width, desc.height);
+		gl::bindTexture(GL_TEXTURE0, source);
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+		gl::checkError();
+	}
+
+public:
+	static constexpr int MAX_LEVELS = 8;
+
+	explicit DualFilterBloom(const TexturedQuad& quad)
+		: quad(quad)
+		, shader("fullscreen.vert", "dualFilter.frag", { { "UPSAMPLE", 2 }, { "THRESHOLD", 2 } })
+	{
+	}
+
+	// the quality slider: every level doubles the radius for a quarter of the previous level's cost
+	auto& levels() { return _levels; }
+	auto& threshold() { return _threshold; }
+
+	// half resolution and filtered, so the composite upsamples it for free
+	static gl::RenderTargetDesc outputDesc(const gl::RenderTargetPool& targets, GLenum format)
+	{
+		return levelDesc(targets, 1, format);
+	}
+
+	// the chain has the format of the output
+	void draw(gl::RenderTargetPool& targets, GLuint texture, const gl::RenderGraph::Target& output, GLenum format)
+	{
+		PROFILE_SCOPE("dual filter bloom");
+		const auto debugGroup = gl::DebugGroup("dual filter bloom");
+
+		const auto levels = std::clamp(_levels, 1, MAX_LEVELS);
+		gl::bindVertexArray(quad.VAO());
+
+		// down: full -> output (level 1) -> chain[0] (level 2) -> ...; the threshold is applied on the way in
+		auto& threshold = shader.get({ 0, _threshold > 0.f });
+		if (_threshold > 0.f)
+		{
+			threshold.use();
+			threshold.setFloat("threshold", _threshold);
+		}
+		pass(threshold, texture, output.framebuffer, levelDesc(targets, 1, format));
+
+		auto& down = shader.get({ 0, 0 });
+		auto source = output.texture;
+		chain.clear();
+		for (auto level = 2; level <= levels; ++level)
+		{
+			const auto& target = chain.emplace_back(targets.acquire(levelDesc(targets, level, format)));
+			pass(down, source, target.framebuffer(), target.desc());
+			source = target.texture();
+		}
+
+		// up: each level is read once, the one above it is free to be written again
+		auto& up = shader.get({ 1, 0 });
+		for (auto level = levels - 1; level >= 1; --level)
+		{
+			const auto isOutput = level == 1;
+			pass(up, source, isOutput ? output.framebuffer : chain[level - 2].framebuffer(), levelDesc(targets, level, format));
+			source = isOutput ? output.texture : chain[level - 2].texture();
+		}
+		chain.clear();
+	}
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Render scale from a PID controller on the GPU time of the frame. The error is relative to the target so the gains
+// don't depend on it; the integral term settles on the scale that fits, proportional and derivative react to
+// spikes. Render targets are reallocated when the scale changes, so the controller steps once per WINDOW measured
+// frames on their mean and the scale moves in STEPs. GPU times arrive a few frames late: after a change the frames
+// still rendered at the old scale are skipped.
+class DynamicResolution final
+{
+	static constexpr float KP = 0.05f, KI = 0.12f, KD = 0.02f; // per step
+	static constexpr float STEP = 0.05f;
+	static constexpr int WINDOW = 15; // frames
+	static constexpr int IN_FLIGHT = 4; // frames
+
+	bool _enabled = true;
+	float _targetMs = 14.f; // some headroom below 60 fps
+	float _minScale = 0.5f;
+	float integral = 0.f, previousError = 0.f;
+	float _scale = 1.f;
+	double _gpuMs = 0.0, sumMs = 0.0;
+	int samples = 0, skip = 0;
+	std::uint64_t lastFrame = ~std::uint64_t{ 0 };
+
+	void reset()
+	{
+		integral = previousError = 0.f;
+		sumMs = 0.0;
+		samples = 0;
+	}
+
+public:
+	auto& enabled() { return _enabled; }
+	auto& targetMs() { return _targetMs; }
+	auto& minScale() { return _minScale; }
+	float scale() const { return _scale; }
+	double gpuMs() const { return _gpuMs; } // of the last frame measured
+
+	// once per frame with the newest frame the profiler has GPU times for, returns the render scale
+	float update(const profiler::Frame* frame)
+	{
+		if (!_enabled)
+		{
+			reset();
+			_scale = 1.f;
+			return _scale;
+		}
+		if (!frame || frame->index == lastFrame)
+			return _scale;
+		lastFrame = frame->index;
+		_gpuMs = frame->gpuMs();
+		if (skip > 0)
+		{
+			skip--;
+			return _scale;
+		}
+		sumMs += _gpuMs;
+		if (++samples < WINDOW)
+			return _scale;
+
+		const auto error = static_cast<float>((_targetMs - sumMs / samples) / _targetMs); // > 0 is headroom
+		sumMs = 0.0;
+		samples = 0;
+		// clamped to what the output can use, no windup while the scale sits at a limit
+		integral = std::clamp(integral + KI * error, _minScale - 1.f, 0.f);
+		const auto output = std::clamp(1.f + integral + KP * error + KD * (error - previousError), _minScale, 1.f);
+		previousError = error;
+
+		const auto stepped = std::round(output / STEP) * STEP;
+		if (stepped != _scale)
+		{
+			_scale = stepped;
+			skip = IN_FLIGHT;
+		}
+		return _scale;
+	}
+};
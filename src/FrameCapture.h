@@ -0,0 +1,478 @@
+#pragma once
+
+#include "Profiler.h"
+#include "OpenGLUtils.h"
+#include "GLState.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Captures the composited frame from the default framebuffer without stalling the render loop.
+// glReadPixels goes into a ring of pixel buffer objects guarded by fences, a PBO is only mapped once its fence
+// signalled (a few frames later), and encoding happens on worker threads.
+namespace capture
+{
+	enum class Format
+	{
+		Raw, // one rgb24 stream, top row first: ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH -i FILE
+		Png, // PATH is a directory, one frame_NNNNNN.png per frame
+		Y4m  // one YUV4MPEG2 stream, 4:2:0
+	};
+
+	Format formatFromPath(const std::filesystem::path& path)
+	{
+		const auto extension = path.extension().string();
+		if (extension == ".y4m")
+			return Format::Y4m;
+		if (extension == ".rgb" || extension == ".raw")
+			return Format::Raw;
+		return Format::Png;
+	}
+
+	Format parseFormat(const std::string& name)
+	{
+		if (name == "raw")
+			return Format::Raw;
+		if (name == "png")
+			return Format::Png;
+		if (name == "y4m")
+			return Format::Y4m;
+		throw std::runtime_error("Unknown capture format: " + name);
+	}
+
+	namespace detail
+	{
+		std::uint32_t crc32(const unsigned char* data, std::size_t size, std::uint32_t crc = 0)
+		{
+			static const auto table = []
+			{
+				auto table = std::array<std::uint32_t, 256>{};
+				for (auto n = std::uint32_t{ 0 }; n < 256; ++n)
+				{
+					auto c = n;
+					for (auto k = 0; k < 8; ++k)
+						c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+					table[n] = c;
+				}
+				return table;
+			}();
+
+			crc = ~crc;
+			for (auto i = std::size_t{ 0 }; i < size; ++i)
+				crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+			return ~crc;
+		}
+
+		void putBigEndian(std::vector<unsigned char>& out, std::uint32_t value)
+		{
+			out.push_back(static_cast<unsigned char>(value >> 24));
+			out.push_back(static_cast<unsigned char>(value >> 16));
+			out.push_back(static_cast<unsigned char>(value >> 8));
+			out.push_back(static_cast<unsigned char>(value));
+		}
+
+		void putChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, std::size_t size)
+		{
+			putBigEndian(out, static_cast<std::uint32_t>(size));
+			const auto begin = out.size();
+			out.insert(out.end(), type, type + 4);
+			out.insert(out.end(), data, data + size);
+			putBigEndian(out, crc32(out.data() + begin, out.size() - begin));
+		}
+
+		// Bottom-up RGBA rows (as read from GL) to an RGB PNG. There is no zlib in the tree, so the image data is
+		// stored uncompressed in deflate "stored" blocks; files are large but valid and encoding is a memcpy.
+		void encodePng(const unsigned char* rgba, unsigned int width, unsigned int height, std::vector<unsigned char>& out)
+		{
+			static constexpr unsigned char SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+			out.assign(std::begin(SIGNATURE), std::end(SIGNATURE));
+
+			auto header = std::vector<unsigned char>{};
+			putBigEndian(header, width);
+			putBigEndian(header, height);
+			header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bit, RGB, deflate, no filter, no interlace
+			putChunk(out, "IHDR", header.data(), header.size());
+
+			// filter byte 0 + RGB per row
+			const auto rowSize = std::size_t{ width } * 3 + 1;
+			auto raw = std::vector<unsigned char>(rowSize * height);
+			for (auto y = 0u; y < height; ++y)
+			{
+				auto* row = raw.data() + rowSize * y;
+				const auto* source = rgba + std::size_t{ width } * 4 * (height - 1 - y);
+				row[0] = 0;
+				for (auto x = 0u; x < width; ++x)
+					std::memcpy(row + 1 + x * 3, source + x * 4, 3);
+			}
+
+			auto zlib = std::vector<unsigned char>{ 0x78, 0x01 };
+			zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+			for (auto offset = std::size_t{ 0 }; offset < raw.size() || offset == 0;)
+			{
+				const auto size = std::min<std::size_t>(raw.size() - offset, 65535);
+				const auto last = offset + size == raw.size();
+				zlib.insert(zlib.end(), {
+					static_cast<unsigned char>(last ? 1 : 0),
+					static_cast<unsigned char>(size), static_cast<unsigned char>(size >> 8),
+					static_cast<unsigned char>(~size), static_cast<unsigned char>(~size >> 8) });
+				zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+				offset += size;
+				if (last)
+					break;
+			}
+
+			auto a = std::uint32_t{ 1 }, b = std::uint32_t{ 0 };
+			for (auto i = std::size_t{ 0 }; i < raw.size();)
+			{
+				// 5552 bytes keep the sums from overflowing before the modulo
+				const auto end = std::min(raw.size(), i + 5552);
+				for (; i < end; ++i)
+				{
+					a += raw[i];
+					b += a;
+				}
+				a %= 65521;
+				b %= 65521;
+			}
+			putBigEndian(zlib, (b << 16) | a);
+
+			putChunk(out, "IDAT", zlib.data(), zlib.size());
+			putChunk(out, "IEND", nullptr, 0);
+		}
+
+		void encodeRaw(const unsigned char* rgba, unsigned int width, unsigned int height, std::vector<unsigned char>& out)
+		{
+			out.resize(std::size_t{ width } * height * 3);
+			for (auto y = 0u; y < height; ++y)
+			{
+				const auto* source = rgba + std::size_t{ width } * 4 * (height - 1 - y);
+				auto* row = out.data() + std::size_t{ width } * 3 * y;
+				for (auto x = 0u; x < width; ++x)
+					std::memcpy(row + x * 3, source + x * 4, 3);
+			}
+		}
+
+		// full range BT.601 (C420jpeg), chroma from the top-left pixel of each 2x2 block
+		void encodeY4mFrame(const unsigned char* rgba, unsigned int width, unsigned int height, std::vector<unsigned char>& out)
+		{
+			static constexpr char FRAME[] = "FRAME\n";
+			const auto chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+			const auto lumaSize = std::size_t{ width } * height, chromaSize = std::size_t{ chromaWidth } * chromaHeight;
+
+			out.resize(sizeof(FRAME) - 1 + lumaSize + 2 * chromaSize);
+			std::memcpy(out.data(), FRAME, sizeof(FRAME) - 1);
+			auto* luma = out.data() + sizeof(FRAME) - 1;
+			auto* u = luma + lumaSize;
+			auto* v = u + chromaSize;
+
+			const auto clamp = [](float value) { return static_cast<unsigned char>(std::clamp(value + 0.5f, 0.f, 255.f)); };
+			for (auto y = 0u; y < height; ++y)
+			{
+				const auto* source = rgba + std::size_t{ width } * 4 * (height - 1 - y);
+				for (auto x = 0u; x < width; ++x)
+				{
+					const float r = source[x * 4], g = source[x * 4 + 1], b = source[x * 4 + 2];
+					luma[std::size_t{ width } * y + x] = clamp(0.299f * r + 0.587f * g + 0.114f * b);
+					if ((x | y) % 2 == 0)
+					{
+						const auto chroma = std::size_t{ chromaWidth } * (y / 2) + x / 2;
+						u[chroma] = clamp(128.f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+						v[chroma] = clamp(128.f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+					}
+				}
+			}
+		}
+	}
+
+	class FrameCapture final
+	{
+		static constexpr std::size_t PBO_COUNT = 3;
+
+		struct Readback
+		{
+			GLuint pbo = 0;
+			GLsync fence = nullptr;
+		};
+
+		struct Job
+		{
+			std::uint64_t sequence;
+			std::vector<unsigned char> pixels;
+		};
+
+		const std::filesystem::path path;
+		const Format format;
+		const unsigned int width, height;
+		const bool lossless;
+		const std::size_t maxQueuedJobs;
+
+		std::array<Readback, PBO_COUNT> ring;
+		std::uint64_t issued = 0, retired = 0; // PBO ring positions
+		std::uint64_t sequence = 0; // frames handed to the workers, numbered without gaps
+
+		std::mutex mutex;
+		std::condition_variable jobAvailable, jobTaken;
+		std::deque<Job> jobs;
+		std::vector<std::vector<unsigned char>> freeBuffers;
+		bool finishing = false;
+		std::vector<std::thread> workers;
+
+		// stream formats need frames in order, workers finish out of order
+		std::mutex streamMutex;
+		std::ofstream stream;
+		std::map<std::uint64_t, std::vector<unsigned char>> reorder;
+		std::uint64_t nextToWrite = 0;
+
+		std::atomic<std::size_t> _written = 0, _dropped = 0;
+		bool finished = false;
+
+		std::vector<unsigned char> takeBuffer()
+		{
+			const auto lock = std::lock_guard(mutex);
+			if (freeBuffers.empty())
+				return {};
+			auto buffer = std::move(freeBuffers.back());
+			freeBuffers.pop_back();
+			return buffer;
+		}
+
+		void writeOrdered(std::uint64_t index, std::vector<unsigned char> encoded)
+		{
+			const auto lock = std::lock_guard(streamMutex);
+			reorder.emplace(index, std::move(encoded));
+			for (auto it = reorder.find(nextToWrite); it != reorder.end(); it = reorder.find(nextToWrite))
+			{
+				stream.write(reinterpret_cast<const char*>(it->second.data()), it->second.size());
+				reorder.erase(it);
+				nextToWrite++;
+				_written++;
+			}
+		}
+
+		void work()
+		{
+			profiler::threadBuffer("capture encoder");
+
+			auto encoded = std::vector<unsigned char>{};
+			while (true)
+			{
+				auto job = Job{};
+				{
+					auto lock = std::unique_lock(mutex);
+					jobAvailable.wait(lock, [this] { return finishing || !jobs.empty(); });
+					if (jobs.empty())
+						return;
+					job = std::move(jobs.front());
+					jobs.pop_front();
+				}
+				jobTaken.notify_one();
+
+				{
+					PROFILE_CPU_SCOPE("capture encode");
+					switch (format)
+					{
+					case Format::Png:
+					{
+						detail::encodePng(job.pixels.data(), width, height, encoded);
+						char name[32];
+						std::snprintf(name, sizeof(name), "frame_%06llu.png", static_cast<unsigned long long>(job.sequence));
+						auto file = std::ofstream(path / name, std::ios::binary);
+						file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+						_written++;
+						break;
+					}
+					case Format::Raw:
+						detail::encodeRaw(job.pixels.data(), width, height, encoded);
+						writeOrdered(job.sequence, std::move(encoded));
+						break;
+					case Format::Y4m:
+						detail::encodeY4mFrame(job.pixels.data(), width, height, encoded);
+						writeOrdered(job.sequence, std::move(encoded));
+						break;
+					}
+				}
+
+				const auto lock = std::lock_guard(mutex);
+				freeBuffers.push_back(std::move(job.pixels));
+			}
+		}
+
+		// maps the oldest PBO once its fence signalled (or waits for it) and queues the pixels for encoding
+		bool retire(bool wait)
+		{
+			auto& readback = ring[retired % PBO_COUNT];
+
+			const auto timeout = wait ? GLuint64{ 1'000'000'000 } : GLuint64{ 0 };
+			const auto status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+			if (status == GL_TIMEOUT_EXPIRED && !wait)
+				return false;
+			if (status == GL_WAIT_FAILED)
+				throw std::runtime_error("glClientWaitSync failed");
+
+			glDeleteSync(readback.fence);
+			readback.fence = nullptr;
+			retired++;
+
+			{
+				auto lock = std::unique_lock(mutex);
+				if (lossless)
+					jobTaken.wait(lock, [this] { return jobs.size() < maxQueuedJobs; });
+				else if (jobs.size() >= maxQueuedJobs)
+				{
+					_dropped++;
+					return true;
+				}
+			}
+
+			PROFILE_CPU_SCOPE("capture map");
+			const auto size = std::size_t{ width } * height * 4;
+			auto pixels = takeBuffer();
+			pixels.resize(size);
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo); gl::checkError();
+			const auto* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT); gl::checkError();
+			std::memcpy(pixels.data(), mapped, size);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER); gl::checkError();
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0); gl::checkError();
+
+			{
+				const auto lock = std::lock_guard(mutex);
+				jobs.push_back(Job{ sequence++, std::move(pixels) });
+			}
+			jobAvailable.notify_one();
+			return true;
+		}
+
+	public:
+		// lossless: never drop a frame, the render loop waits for readback and encoders instead (offline rendering)
+		FrameCapture(std::filesystem::path path, Format format, unsigned int width, unsigned int height, unsigned int fps, bool lossless)
+			: path(std::move(path))
+			, format(format)
+			, width(width)
+			, height(height)
+			, lossless(lossless)
+			, maxQueuedJobs(std::clamp(std::thread::hardware_concurrency(), 2u, 8u) * 2)
+		{
+			if (format == Format::Png)
+				std::filesystem::create_directories(this->path);
+			else
+			{
+				stream.open(this->path, std::ios::binary);
+				if (!stream.is_open())
+					throw std::runtime_error("Could not open file:" + this->path.string());
+				if (format == Format::Y4m)
+					stream << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+			}
+
+			for (auto& readback : ring)
+			{
+				glGenBuffers(1, &readback.pbo); gl::checkError();
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo); gl::checkError();
+				glBufferData(GL_PIXEL_PACK_BUFFER, std::size_t{ width } * height * 4, nullptr, GL_STREAM_READ); gl::checkError();
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0); gl::checkError();
+
+			const auto workerCount = std::clamp(std::thread::hardware_concurrency(), 2u, 8u) - 1;
+			for (auto i = 0u; i < workerCount; ++i)
+				workers.emplace_back([this] { work(); });
+		}
+
+		~FrameCapture()
+		{
+			finish();
+		}
+
+		FrameCapture(const FrameCapture&) = delete;
+		FrameCapture& operator=(const FrameCapture&) = delete;
+
+		// Call after compositing into the default framebuffer, before the UI is drawn, or with the texture the frame
+		// was composited into. Reading a texture doesn't depend on the window: parts of it that are covered or off
+		// screen are undefined in the default framebuffer.
+		void frame(unsigned int framebufferWidth, unsigned int framebufferHeight, GLuint texture = 0)
+		{
+			PROFILE_SCOPE("capture readback");
+
+			if (framebufferWidth != width || framebufferHeight != height)
+			{
+				_dropped++; // the window was resized, frames no longer fit
+				return;
+			}
+
+			// retire finished readbacks, oldest first
+			while (retired < issued && retire(false))
+				;
+
+			// ring full: the GPU is PBO_COUNT frames behind
+			if (issued - retired == PBO_COUNT)
+			{
+				if (lossless)
+					retire(true);
+				else
+				{
+					_dropped++;
+					return;
+				}
+			}
+
+			auto& readback = ring[issued % PBO_COUNT];
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo); gl::checkError();
+			if (texture)
+			{
+				gl::bindTexture(GL_TEXTURE0, texture);
+				glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); gl::checkError();
+			}
+			else
+			{
+				gl::bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+				glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); gl::checkError();
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0); gl::checkError();
+			readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); gl::checkError();
+			issued++;
+		}
+
+		// drains outstanding readbacks and encoders, called by the destructor
+		void finish()
+		{
+			if (finished)
+				return;
+			finished = true;
+
+			while (retired < issued)
+				retire(true);
+
+			{
+				const auto lock = std::lock_guard(mutex);
+				finishing = true;
+			}
+			jobAvailable.notify_all();
+			for (auto& worker : workers)
+				worker.join();
+			stream.flush();
+
+			for (auto& readback : ring)
+				glDeleteBuffers(1, &readback.pbo);
+		}
+
+		const std::filesystem::path& output() const { return path; }
+		std::size_t written() const { return _written; }
+		std::size_t dropped() const { return _dropped; }
+		std::size_t pending() const { return static_cast<std::size_t>(sequence - _written); }
+	};
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+
+// Fixed-size ring buffer, push is O(1). data()/offset() match ImGui::PlotLines' values_offset parameter.
+template<class T, std::size_t N>
+class RingBuffer final
+{
+	std::array<T, N> values{};
+	std::size_t head = 0;
+
+public:
+	void push(T value)
+	{
+		values[head] = value;
+		head = (head + 1) % N;
+	}
+
+	const T* data() const { return values.data(); }
+	constexpr std::size_t size() const { return N; }
+	std::size_t offset() const { return head; } // index of the oldest value
+	const T& latest() const { return values[(head + N - 1) % N]; }
+};
+
+// Log-scale histogram of frame times over the whole run. Bucket bounds grow by RATIO, so any percentile read back is
+// within ~1% of the real value, with constant memory and O(1) insertion (same idea as an HDR histogram).
+class FrameTimeHistogram final
+{
+	static constexpr double MIN_MS = 0.01;
+	static constexpr double MAX_MS = 10'000.0;
+	static constexpr double RATIO = 1.02;
+	static constexpr std::size_t BUCKETS = 700; // ceil(log(MAX_MS / MIN_MS) / log(RATIO))
+
+	std::array<std::uint64_t, BUCKETS> buckets{};
+	std::uint64_t _count = 0;
+	double _sum = 0.0, _max = 0.0, _min = MAX_MS;
+
+	static std::size_t bucket(double ms)
+	{
+		if (ms <= MIN_MS)
+			return 0;
+		const auto index = static_cast<std::size_t>(std::log(ms / MIN_MS) / std::log(RATIO));
+		return std::min(index, BUCKETS - 1);
+	}
+
+	// geometric middle of the bucket
+	static double value(std::size_t bucket)
+	{
+		return MIN_MS * std::pow(RATIO, bucket + 0.5);
+	}
+
+public:
+	void add(double ms)
+	{
+		buckets[bucket(ms)]++;
+		_count++;
+		_sum += ms;
+		_max = std::max(_max, ms);
+		_min = std::min(_min, ms);
+	}
+
+	std::uint64_t count() const { return _count; }
+	double mean() const { return _count ? _sum / _count : 0.0; }
+	double max() const { return _max; }
+	double min() const { return _count ? _min : 0.0; }
+
+	double percentile(double p) const
+	{
+		if (_count == 0)
+			return 0.0;
+
+		const auto rank = static_cast<std::uint64_t>(std::ceil(p / 100.0 * _count));
+		auto seen = std::uint64_t{ 0 };
+		for (auto i = std::size_t{ 0 }; i < BUCKETS; ++i)
+		{
+			seen += buckets[i];
+			if (seen >= std::max<std::uint64_t>(rank, 1))
+				return std::min(value(i), _max);
+		}
+		return _max;
+	}
+
+	// coarse view for plotting: bins spanning equal ranges on a log scale between min and max
+	template<std::size_t BINS>
+	std::array<float, BINS> bins(double& fromMs, double& toMs) const
+	{
+		auto result = std::array<float, BINS>{};
+		const auto first = bucket(min()), last = bucket(max()) + 1;
+		fromMs = MIN_MS * std::pow(RATIO, first);
+		toMs = MIN_MS * std::pow(RATIO, last);
+		for (auto i = first; i < last; ++i)
+			result[(i - first) * BINS / (last - first)] += static_cast<float>(buckets[i]);
+		return result;
+	}
+};
+
+class FrameStats final
+{
+	RingBuffer<float, 200> recent;
+	FrameTimeHistogram histogram;
+	double _budgetMs = 1000.0 / 60.0;
+	std::uint64_t _hitches = 0;
+
+public:
+	void add(float frameTimeMs)
+	{
+		recent.push(frameTimeMs);
+		histogram.add(frameTimeMs);
+		if (frameTimeMs > _budgetMs)
+			_hitches++;
+	}
+
+	const auto& history() const { return recent; }
+	const auto& allFrames() const { return histogram; }
+	std::uint64_t hitches() const { return _hitches; }
+
+	double budgetMs() const { return _budgetMs; }
+	void budgetMs(double budget) { _budgetMs = budget; } // applies to frames measured from now on
+
+	void print(std::ostream& out) const
+	{
+		out << "Frame times over " << histogram.count() << " frames [ms]:"
+			<< " mean " << histogram.mean()
+			<< ", p50 " << histogram.percentile(50.0)
+			<< ", p95 " << histogram.percentile(95.0)
+			<< ", p99 " << histogram.percentile(99.0)
+			<< ", max " << histogram.max()
+			<< "; " << _hitches << " frames over the " << _budgetMs << " ms budget" << std::endl;
+	}
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "OpenGLUtils.h"
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace gl
+{
+	// KHR_debug is core in 4.3; the context asks for 3.3 and glad only loads the entry points when the driver gave us more
+	bool debugOutputAvailable()
+	{
+		return GLAD_GL_VERSION_4_3 && glDebugMessageCallback;
+	}
+
+	// names objects in the debug output and in RenderDoc/apitrace captures
+	void label(GLenum identifier, GLuint name, std::string_view label)
+	{
+		if (debugOutputAvailable())
+			glObjectLabel(identifier, name, static_cast<GLsizei>(label.size()), label.data());
+	}
+
+	// groups the calls of a pass in the debug output and in captures
+	class DebugGroup final
+	{
+		const bool pushed;
+
+	public:
+		explicit DebugGroup(const char* name)
+			: pushed(debugOutputAvailable())
+		{
+			if (pushed)
+				glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+		}
+
+		~DebugGroup()
+		{
+			if (pushed)
+				glPopDebugGroup();
+		}
+
+		DebugGroup(const DebugGroup&) = delete;
+		DebugGroup& operator=(const DebugGroup&) = delete;
+	};
+
+	namespace detail
+	{
+		const char* debugType(GLenum type)
+		{
+			switch (type)
+			{
+			case GL_DEBUG_TYPE_ERROR: return "error";
+			case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+			case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+			case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+			case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+			default: return "other";
+			}
+		}
+
+		const char* debugSeverity(GLenum severity)
+		{
+			switch (severity)
+			{
+			case GL_DEBUG_SEVERITY_HIGH: return "high";
+			case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+			case GL_DEBUG_SEVERITY_LOW: return "low";
+			default: return "notification";
+			}
+		}
+
+		void APIENTRY debugCallback(GLenum, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void*)
+		{
+			counters().debugMessages++;
+			std::cerr << "GL " << debugType(type) << " (" << debugSeverity(severity) << ", " << id << "): "
+				<< std::string_view(message, length < 0 ? std::char_traits<char>::length(message) : length) << std::endl;
+		}
+	}
+
+	ErrorChecks parseErrorChecks(const std::string& mode)
+	{
+		if (mode == "call") return ErrorChecks::Call;
+		if (mode == "debug") return ErrorChecks::Debug;
+		if (mode == "frame") return ErrorChecks::Frame;
+		if (mode == "off") return ErrorChecks::Off;
+		throw std::runtime_error("Unknown GL error mode: " + mode);
+	}
+
+	// Debug mode installs the callback and leaves glGetError to checkFrameErrors(); without KHR_debug it falls
+	// back to polling after every call so nothing goes unreported. Returns the mode in effect.
+	ErrorChecks enableErrorChecks(ErrorChecks mode)
+	{
+		if (mode == ErrorChecks::Debug && !debugOutputAvailable())
+			mode = ErrorChecks::Call;
+
+		if (mode == ErrorChecks::Debug)
+		{
+			glEnable(GL_DEBUG_OUTPUT);
+			// the callback runs inside the offending call, a breakpoint there shows who made it
+			glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+			glDebugMessageCallback(detail::debugCallback, nullptr);
+			// group push/pop and notifications (buffer placement and the like) are noise
+			glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+			glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+			glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+		}
+		else if (debugOutputAvailable())
+			glDisable(GL_DEBUG_OUTPUT);
+
+		errorChecks() = mode;
+		return mode;
+	}
+}
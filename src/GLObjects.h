@@ -0,0 +1,63 @@
+#pragma once
+
+#include "OpenGLUtils.h"
+#include "GLState.h"
+
+#include <glad/glad.h>
+
+#include <utility>
+
+namespace gl
+{
+	namespace detail
+	{
+		void deleteTexture(GLuint id) { glDeleteTextures(1, &id); }
+		void deleteFramebuffer(GLuint id) { glDeleteFramebuffers(1, &id); }
+		void deleteVertexArray(GLuint id) { glDeleteVertexArrays(1, &id); }
+		void deleteBuffer(GLuint id) { glDeleteBuffers(1, &id); }
+	}
+
+	// Owns one GL object name, movable but not copyable. Converts to the name so it drops into GL calls.
+	// A deleted object that was bound is unbound by GL, the state cache forgets everything to match.
+	template<void (*Delete)(GLuint)>
+	class Handle final
+	{
+		GLuint id = 0;
+
+	public:
+		Handle() = default;
+		explicit Handle(GLuint id) : id(id) {}
+		~Handle() { reset(); }
+
+		Handle(Handle&& other) noexcept : id(std::exchange(other.id, 0)) {}
+		Handle& operator=(Handle&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				id = std::exchange(other.id, 0);
+			}
+			return *this;
+		}
+
+		Handle(const Handle&) = delete;
+		Handle& operator=(const Handle&) = delete;
+
+		operator GLuint() const { return id; }
+
+		void reset()
+		{
+			if (id == 0)
+				return;
+			Delete(id);
+			gl::checkError();
+			gl::invalidateState();
+			id = 0;
+		}
+	};
+
+	using Texture = Handle<detail::deleteTexture>;
+	using Framebuffer = Handle<detail::deleteFramebuffer>;
+	using VertexArray = Handle<detail::deleteVertexArray>;
+	using Buffer = Handle<detail::deleteBuffer>;
+}
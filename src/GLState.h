@@ -0,0 +1,169 @@
+#pragma once
+
+#include "OpenGLUtils.h"
+
+#include <glad/glad.h>
+
+#include <array>
+
+namespace gl
+{
+	// Shadow copy of the state the frame keeps switching: program, vertex array, framebuffers, 2D texture units and
+	// blend/depth. The wrappers below skip calls that would set what is already current and count issued vs skipped
+	// calls in counters(). Setup code (constructors, resize) still calls GL directly and ImGui draws behind its back,
+	// so the shadow is invalidated at the start of every frame and whenever a tracked object is deleted, an id the
+	// driver hands out again must not look bound.
+	class StateCache final
+	{
+	public:
+		static constexpr GLuint UNKNOWN = ~GLuint{ 0 };
+		static constexpr GLuint TEXTURE_UNITS = 16;
+
+		GLuint program;
+		GLuint vertexArray;
+		GLuint drawFramebuffer, readFramebuffer;
+		GLuint activeUnit;
+		std::array<GLuint, TEXTURE_UNITS> textures;
+		GLuint blend, depthTest; // GL_TRUE, GL_FALSE or UNKNOWN
+		GLuint blendSource, blendDestination;
+		GLuint depthFunction;
+
+		StateCache() { invalidate(); }
+
+		void invalidate()
+		{
+			program = vertexArray = drawFramebuffer = readFramebuffer = activeUnit = UNKNOWN;
+			textures.fill(UNKNOWN);
+			blend = depthTest = blendSource = blendDestination = depthFunction = UNKNOWN;
+		}
+	};
+
+	StateCache& state()
+	{
+		static auto cache = StateCache{};
+		return cache;
+	}
+
+	void invalidateState()
+	{
+		state().invalidate();
+	}
+
+	namespace detail
+	{
+		// true when the call can be skipped, otherwise remembers the new value
+		bool current(GLuint& shadow, GLuint value)
+		{
+			if (shadow == value)
+			{
+				counters().stateSkipped++;
+				return true;
+			}
+			shadow = value;
+			counters().stateIssued++;
+			return false;
+		}
+
+		GLuint* capability(GLenum cap)
+		{
+			switch (cap)
+			{
+			case GL_BLEND: return &state().blend;
+			case GL_DEPTH_TEST: return &state().depthTest;
+			default: return nullptr;
+			}
+		}
+	}
+
+	void useProgram(GLuint program)
+	{
+		if (detail::current(state().program, program))
+			return;
+		glUseProgram(program);
+		gl::checkError();
+	}
+
+	void bindVertexArray(GLuint vertexArray)
+	{
+		if (detail::current(state().vertexArray, vertexArray))
+			return;
+		glBindVertexArray(vertexArray);
+		gl::checkError();
+	}
+
+	void bindFramebuffer(GLenum target, GLuint framebuffer)
+	{
+		auto& cache = state();
+		if (target == GL_FRAMEBUFFER)
+		{
+			// both bindings in one call, only skipped when both already match
+			auto both = cache.drawFramebuffer == cache.readFramebuffer ? cache.drawFramebuffer : StateCache::UNKNOWN;
+			if (detail::current(both, framebuffer))
+				return;
+			cache.drawFramebuffer = cache.readFramebuffer = framebuffer;
+		}
+		else if (detail::current(target == GL_READ_FRAMEBUFFER ? cache.readFramebuffer : cache.drawFramebuffer, framebuffer))
+			return;
+		glBindFramebuffer(target, framebuffer);
+		gl::checkError();
+	}
+
+	// unit as GL_TEXTURE0 + i, like glActiveTexture
+	void activeTexture(GLenum unit)
+	{
+		if (detail::current(state().activeUnit, unit - GL_TEXTURE0))
+			return;
+		glActiveTexture(unit);
+		gl::checkError();
+	}
+
+	// GL_TEXTURE_2D on the given unit, which is left active
+	void bindTexture(GLenum unit, GLuint texture)
+	{
+		activeTexture(unit);
+		const auto index = unit - GL_TEXTURE0;
+		if (index < StateCache::TEXTURE_UNITS && detail::current(state().textures[index], texture))
+			return;
+		glBindTexture(GL_TEXTURE_2D, texture);
+		gl::checkError();
+	}
+
+	void enable(GLenum cap)
+	{
+		if (auto* shadow = detail::capability(cap); shadow && detail::current(*shadow, GL_TRUE))
+			return;
+		glEnable(cap);
+		gl::checkError();
+	}
+
+	void disable(GLenum cap)
+	{
+		if (auto* shadow = detail::capability(cap); shadow && detail::current(*shadow, GL_FALSE))
+			return;
+		glDisable(cap);
+		gl::checkError();
+	}
+
+	void blendFunc(GLenum source, GLenum destination)
+	{
+		auto& cache = state();
+		if (cache.blendSource == source && cache.blendDestination == destination)
+		{
+			counters().stateSkipped++;
+			return;
+		}
+		cache.blendSource = source;
+		cache.blendDestination = destination;
+		counters().stateIssued++;
+		glBlendFunc(source, destination);
+		gl::checkError();
+	}
+
+	void depthFunc(GLenum function)
+	{
+		if (detail::current(state().depthFunction, function))
+			return;
+		glDepthFunc(function);
+		gl::checkError();
+	}
+}
@@ -1,108 +1,229 @@
 #pragma once
 
 #include "OpenGLUtils.h"
+#include "GLState.h"
+#include "GLDebug.h"
+#include "RenderTargets.h"
+#include "RenderGraph.h"
 #include "TexturedQuad.h"
 #include "Shader.h"
+#include "Profiler.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtx/compatibility.hpp>
 
-class GaussianBlur final
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace blur
 {
-	const GLuint horizontalBlurTexture, verticalBlurTexture;
-	const GLuint horizontalFBO, verticalFBO;
-	const GLuint quadVAO; // TODO this might not exist
-	const Shader shader;
-	int _iterations = 9;
+	constexpr std::size_t MAX_TAPS = 32; // blur.glsl
+	constexpr int MAX_COMPUTE_RADIUS = 32; // blurCompute.glsl, bounded by its shared memory
 
-public:
-	GaussianBlur(unsigned int width, unsigned int height, const TexturedQuad& quad)
-		: horizontalBlurTexture(gl::genTexture(width, height))
-		, verticalBlurTexture(gl::genTexture(width, height))
-		, horizontalFBO(gl::genFramebuffer(horizontalBlurTexture))
-		, verticalFBO(gl::genFramebuffer(verticalBlurTexture))
-		, quadVAO(quad.VAO())
-		, shader("blur.glsl")
+	// 3 sigma covers 99.7%
+	int radius(float sigma)
 	{
+		return std::max(static_cast<int>(std::ceil(3.f * sigma)), 1);
 	}
 
-	~GaussianBlur()
+	// one side of a normalised gaussian, [0] is the centre texel
+	std::vector<float> gaussianWeights(float sigma, int radius)
 	{
-		unsigned fbos[] = { horizontalFBO, verticalFBO };
-		unsigned textures[] = { horizontalBlurTexture, verticalBlurTexture };
-		glDeleteFramebuffers(2, fbos); gl::checkError();
-		glDeleteTextures(2, textures); gl::checkError();
-		glDeleteVertexArrays(1, &quadVAO); gl::checkError();
+		auto weights = std::vector<float>(radius + 1);
+		auto sum = 0.f;
+		for (auto i = 0; i <= radius; ++i)
+		{
+			weights[i] = std::exp(-0.5f * i * i / (sigma * sigma));
+			sum += i == 0 ? weights[i] : 2.f * weights[i];
+		}
+		for (auto& weight : weights)
+			weight /= sum;
+		return weights;
 	}
 
-	auto texture() { return horizontalBlurTexture; }
-	auto& iterations() { return _iterations; }
+	// Neighbouring texels i, i + 1 folded into one tap between them, weighted so a bilinear fetch there returns
+	// w(i) * t(i) + w(i + 1) * t(i + 1): radius r costs r / 2 + 1 fetches per side instead of r + 1. Needs GL_LINEAR
+	// sources.
+	struct Kernel
+	{
+		std::vector<float> offsets; // in texels
+		std::vector<float> weights;
+	};
 
-	void draw(GLuint texture)
+	Kernel gaussianKernel(float sigma)
 	{
+		const auto texels = gaussianWeights(sigma, std::min(radius(sigma), static_cast<int>(MAX_TAPS - 1) * 2));
+
+		auto kernel = Kernel{};
+		kernel.offsets.push_back(0.f);
+		kernel.weights.push_back(texels[0]);
+		for (auto i = std::size_t{ 1 }; i < texels.size(); i += 2)
+		{
+			const auto second = i + 1 < texels.size() ? texels[i + 1] : 0.f;
+			const auto weight = texels[i] + second;
+			kernel.offsets.push_back((i * texels[i] + (i + 1) * second) / weight);
+			kernel.weights.push_back(weight);
+		}
+		return kernel;
+	}
+}
+
+// Separable gaussian of any sigma. The fragment path runs a horizontal and a vertical pass with the linear-sampled
+// kernel. On 4.3 contexts a compute shader does both directions in one dispatch out of shared memory, for radii it
+// has room for (sigma up to ~10.6) and targets it can pack there (rgb8, r11f_g11f_b10f). Its output for rgb8 is
+// rgba8 as image stores can't write rgb8.
+class GaussianBlur final
+{
+	const TexturedQuad& quad;
+	Shader shader;
+	const bool computeSupported;
+	std::optional<Shader> computeShader; // built for computeFormat
+	GLenum computeFormat = 0;
+	// what 9 iterations of the old fixed 9-tap kernel (variance 2.85 texels^2 per pass) added up to
+	float _sigma = std::sqrt(10.f * 2.852f);
+	float uploadedSigma = 0.f, computeSigma = 0.f;
+	int taps = 0;
+	bool _compute = true;
+
+	void uploadKernel()
+	{
+		if (_sigma == uploadedSigma)
+			return;
+
+		const auto kernel = blur::gaussianKernel(_sigma);
+		taps = static_cast<int>(kernel.weights.size());
 		shader.use();
+		shader.setInt("taps", taps);
+		shader.setFloatArray("offsets", kernel.offsets.data(), taps);
+		shader.setFloatArray("weights", kernel.weights.data(), taps);
+		uploadedSigma = _sigma;
+	}
 
-		glBindVertexArray(quadVAO);
-		gl::checkError();
+	void uploadComputeKernel()
+	{
+		if (_sigma == computeSigma)
+			return;
 
-		glActiveTexture(GL_TEXTURE0);
-		gl::checkError();
+		const auto radius = blur::radius(_sigma);
+		const auto weights = blur::gaussianWeights(_sigma, radius);
+		computeShader->use();
+		computeShader->setInt("result", 0);
+		computeShader->setInt("radius", radius);
+		computeShader->setFloatArray("weights", weights.data(), radius + 1);
+		computeSigma = _sigma;
+	}
 
-		// TODO this can be shortened
-		glBindFramebuffer(GL_FRAMEBUFFER, horizontalFBO);
-		gl::checkError();
-		shader.setInt("horizontal", true);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		gl::checkError();
+	void drawFragment(gl::RenderTargetPool& targets, GLuint texture, GLuint framebuffer, GLenum format)
+	{
+		uploadKernel();
+		const auto horizontal = targets.acquire(format, GL_LINEAR);
+
+		shader.use();
+		gl::bindVertexArray(quad.VAO());
+
+		gl::bindFramebuffer(GL_FRAMEBUFFER, horizontal.framebuffer());
+		shader.setVec2("direction", 1.f, 0.f);
+		gl::bindTexture(GL_TEXTURE0, texture);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 		gl::checkError();
 
-		glBindFramebuffer(GL_FRAMEBUFFER, verticalFBO);
-		gl::checkError();
-		shader.setInt("horizontal", false);
-		glBindTexture(GL_TEXTURE_2D, horizontalBlurTexture);
-		gl::checkError();
+		gl::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		shader.setVec2("direction", 0.f, 1.f);
+		gl::bindTexture(GL_TEXTURE0, horizontal.texture());
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 		gl::checkError();
+	}
 
-		for (auto i = 0u; i < _iterations; ++i)
-		{
-			glBindFramebuffer(GL_FRAMEBUFFER, horizontalFBO);
-			gl::checkError();
-			shader.setInt("horizontal", true);
-			glBindTexture(GL_TEXTURE_2D, verticalBlurTexture);
-			gl::checkError();
-			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-			gl::checkError();
+	void drawCompute(const gl::RenderTargetPool& targets, GLuint texture, GLuint output, GLenum format)
+	{
+		constexpr auto TILE = 16u; // blurCompute.glsl
 
-			glBindFramebuffer(GL_FRAMEBUFFER, verticalFBO);
-			gl::checkError();
-			shader.setInt("horizontal", false);
-			glBindTexture(GL_TEXTURE_2D, horizontalBlurTexture);
-			gl::checkError();
-			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-			gl::checkError();
+		// format switches are rare, one variant is kept
+		if (computeFormat != format)
+		{
+			computeShader.reset();
+			computeShader.emplace("blurCompute.glsl", std::vector<std::string>{ format == GL_R11F_G11F_B10F ? "HDR 1" : "HDR 0" });
+			computeFormat = format;
+			computeSigma = 0.f;
 		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		uploadComputeKernel();
+		computeShader->use();
+		gl::bindTexture(GL_TEXTURE0, texture);
+		glBindImageTexture(0, output, 0, GL_FALSE, 0, GL_WRITE_ONLY, outputFormat(format));
+		gl::checkError();
+		glDispatchCompute((targets.width() + TILE - 1) / TILE, (targets.height() + TILE - 1) / TILE, 1);
 		gl::checkError();
-		glBindVertexArray(0);
+		// the composite samples what the image stores wrote
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
 		gl::checkError();
-		//glUseProgram(0);
-		//gl::checkError();
 	}
 
-	void resize(unsigned int width, unsigned int height)
+public:
+	explicit GaussianBlur(const TexturedQuad& quad)
+		: quad(quad)
+		, shader("blur.glsl")
+		, computeSupported(GLAD_GL_VERSION_4_3)
 	{
-		glBindTexture(GL_TEXTURE_2D, horizontalBlurTexture);
-		gl::checkError();
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-		gl::checkError();
-		glBindTexture(GL_TEXTURE_2D, verticalBlurTexture);
-		gl::checkError();
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-		gl::checkError();
-		glBindTexture(GL_TEXTURE_2D, 0);
-		gl::checkError();
+	}
+
+	auto& sigma() { return _sigma; }
+	int fetches() const { return 2 * taps - 1; } // per pass and pixel, fragment path
+
+	bool computeAvailable() const { return computeSupported; }
+	auto& compute() { return _compute; } // preferred when available
+
+	bool usesCompute(GLenum format) const
+	{
+		return _compute && computeSupported && blur::radius(_sigma) <= blur::MAX_COMPUTE_RADIUS
+			&& (format == GL_RGB8 || format == GL_R11F_G11F_B10F);
+	}
+
+	// of the output target draw() expects for a format of the input, changes with the path
+	GLenum outputFormat(GLenum format) const { return usesCompute(format) && format == GL_RGB8 ? GL_RGBA8 : format; }
+
+	// texture and the output have to be GL_LINEAR and full size, the fragment path leases a scratch target
+	void draw(gl::RenderTargetPool& targets, GLuint texture, const gl::RenderGraph::Target& output, GLenum format)
+	{
+		PROFILE_SCOPE("gaussian blur");
+		const auto debugGroup = gl::DebugGroup("gaussian blur");
+
+		if (usesCompute(format))
+			drawCompute(targets, texture, output.texture, format);
+		else
+			drawFragment(targets, texture, output.framebuffer, format);
+	}
+
+	// Blurs texture with both paths and returns the largest difference of a channel, relative to the fragment
+	// path's value where that is above 1; -1 when the compute path can't run. The two differ by the GPU's bilinear
+	// weight precision and the summation order, so a step of the format (1/255, 1/64 for 6 bit mantissas).
+	float verify(gl::RenderTargetPool& targets, GLuint texture, GLenum format)
+	{
+		if (!usesCompute(format))
+			return -1.f;
+
+		const auto fragment = targets.acquire(outputFormat(format), GL_LINEAR);
+		const auto compute = targets.acquire(outputFormat(format), GL_LINEAR);
+		glViewport(0, 0, targets.width(), targets.height());
+		drawFragment(targets, texture, fragment.framebuffer(), format);
+		drawCompute(targets, texture, compute.texture(), format);
+		glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+		const auto values = std::size_t{ targets.width() } * targets.height() * 4;
+		auto expected = std::vector<float>(values), actual = std::vector<float>(values);
+		for (auto [lease, data] : { std::pair(&fragment, expected.data()), std::pair(&compute, actual.data()) })
+		{
+			gl::bindFramebuffer(GL_READ_FRAMEBUFFER, lease->framebuffer());
+			glReadPixels(0, 0, targets.width(), targets.height(), GL_RGBA, GL_FLOAT, data);
+			gl::checkError();
+		}
+
+		auto difference = 0.f;
+		for (auto i = std::size_t{ 0 }; i < values; ++i)
+			difference = std::max(difference, std::abs(expected[i] - actual[i]) / std::max(expected[i], 1.f));
+		return difference;
 	}
 };
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdexcept>
+#include <string>
+
+// Offscreen OpenGL context through EGL. On Mesa the surfaceless platform works without a display server or GPU (llvmpipe).
+class HeadlessContext final
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLSurface surface = EGL_NO_SURFACE;
+	EGLContext context = EGL_NO_CONTEXT;
+
+	static EGLDisplay getDisplay()
+	{
+		const auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (getPlatformDisplay)
+		{
+			const auto surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			if (surfaceless != EGL_NO_DISPLAY)
+				return surfaceless;
+		}
+
+		return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	static void check(bool result, const char* what)
+	{
+		if (!result)
+			throw std::runtime_error(std::string(what) + " failed: EGL error " + std::to_string(eglGetError()));
+	}
+
+public:
+	// debug asks for a debug context (EGL 1.5), where KHR_debug reports everything the driver knows
+	HeadlessContext(unsigned int width, unsigned int height, bool debug = false)
+		: display(getDisplay())
+	{
+		check(display != EGL_NO_DISPLAY, "eglGetDisplay");
+
+		auto major = EGLint{ 0 }, minor = EGLint{ 0 };
+		check(eglInitialize(display, &major, &minor), "eglInitialize");
+		check(eglBindAPI(EGL_OPENGL_API), "eglBindAPI");
+
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_DEPTH_SIZE, 24,
+			EGL_NONE
+		};
+		auto config = EGLConfig{};
+		auto configCount = EGLint{ 0 };
+		check(eglChooseConfig(display, configAttributes, &config, 1, &configCount) && configCount > 0, "eglChooseConfig");
+
+		const EGLint surfaceAttributes[] = {
+			EGL_WIDTH, static_cast<EGLint>(width),
+			EGL_HEIGHT, static_cast<EGLint>(height),
+			EGL_NONE
+		};
+		surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+		check(surface != EGL_NO_SURFACE, "eglCreatePbufferSurface");
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			debug ? EGL_CONTEXT_OPENGL_DEBUG : EGL_NONE, EGL_TRUE, // ends the list early otherwise, EGL 1.4 rejects the attribute
+			EGL_NONE
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		check(context != EGL_NO_CONTEXT, "eglCreateContext");
+
+		check(eglMakeCurrent(display, surface, surface, context), "eglMakeCurrent");
+
+		if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)))
+			throw std::runtime_error("Failed to initialize GLAD");
+	}
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	~HeadlessContext()
+	{
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+		eglDestroySurface(display, surface);
+		eglTerminate(display);
+	}
+
+	void swapBuffers()
+	{
+		eglSwapBuffers(display, surface);
+	}
+};
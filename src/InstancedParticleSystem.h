@@ -1,97 +1,120 @@
 #pragma once
 
 #include "Shader.h"
-#include "Timer.h"
+#include "GLState.h"
+#include "GLDebug.h"
+#include "GLObjects.h"
+#include "ShaderVariants.h"
+#include "Profiler.h"
+#include "Random.h"
+#include "ParticleProperties.h"
+#include "ParticleStore.h"
 #include "OpenGLUtils.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtx/compatibility.hpp>
 #include <glad/glad.h>
 
-#include <list>
+#include <algorithm>
+#include <cstdint>
 #include <random>
 #include <iostream>
 
-namespace rng
-{
-	auto Float()
-	{
-		static std::random_device rd{};
-		static auto seed = std::mt19937{ rd() };
-		static auto distribution = std::uniform_real_distribution<float>(-0.002f, 0.002f);
-
-		return distribution(seed);
-	}
-}
-
 class InstancedParticleSystem final
 {
-	const GLuint VAO, VBO, EBO, instanceVBO, textureId, FBO;
-	const Shader squareShader, circleShader, triangleShader;
-
-	struct Particle
+public:
+	// what is uploaded per particle, INSTANCE_FORMAT in instanced.glsl
+	enum class InstanceFormat : int
 	{
-		glm::vec4 startColor;
-		glm::vec4 endColor;
-		glm::vec3 position;
-		glm::vec3 velocity;
-		glm::vec3 acceleration;
-		float creationTime;
-		float totalLifeTime;
-		float rotationSpeed;
-		float scale;
-		bool isAlive = false;
+		Compact = 0, // InstanceData, 32 bytes
+		Matrix = 1 // MatrixInstance, 80 bytes, the original layout, kept for comparison and for rotated particles
 	};
 
-	std::list<Particle> aliveParticles;
+private:
+	const gl::VertexArray VAO, pointsVAO;
+	const gl::Buffer VBO, EBO, instanceVBO;
 
-	struct
-	{
-		glm::vec3 initialVelocity = { 0.f, 0.f, 0.f };
-		glm::vec3 acceleration = { 0.f, 0.f, 0.f };
-		glm::vec4 startColor = { 0.f, 0.5f, 1.f, 1.f };
-		glm::vec4 endColor = { 1.f, 0.f, 0.f, 1.f };
-		int totalLifetimeSeconds = 5;
-		int spawnCount = 50;
-		float scale = 0.0025f;
-		int particleShape = 1; // 0 - square, 1 - circle // TODO enum or sth (fast impl for imgui exposure)...
-		float shapeThickness = 0.8f;
-		bool randomVelocity = true;
-		bool randomAcceleration = false;
-	} properties;
+	// shape x antialiasing x instance format x points, see instanced.glsl
+	ShaderVariants shaders;
+
+	ParticleStore particles;
+
+	ParticleProperties properties;
 
 	const std::size_t particlesLimit;
 
 	struct InstanceData
+	{
+		glm::vec4 color;
+		glm::vec4 positionScale; // xyz position, w scale
+	};
+
+	struct MatrixInstance
 	{
 		glm::vec4 color;
 		glm::mat4 transformation;
 	};
 
 	std::vector<InstanceData> instancesData;
+	std::vector<MatrixInstance> matrixData; // only filled with InstanceFormat::Matrix
+	std::size_t instancesCount = 0;
+
+	bool _antialias = false;
+	InstanceFormat _instanceFormat = InstanceFormat::Compact;
+	InstanceFormat layoutFormat = InstanceFormat::Compact; // what the VAO's instance attributes are set up for
+
+	// LOD: the draw switches to point sprites while every particle projects smaller than this
+	float _pointSpritesBelow = 4.f; // pixels, 0 never
+	glm::vec4 viewDepth{ 0.f }; // the view matrix's z row negated, gives the depth in front of the camera
+	float pixelsPerUnit = 0.f; // at depth 1, 0 until lodCamera()
+	float _projectedSize = 0.f; // largest of the last fill(), pixels
+	bool _pointSprites = false;
 
 	auto& getShader()
 	{
-		auto id = properties.particleShape;
-		if (id == 0)
-			return squareShader;
-		else if (id == 1)
-			return circleShader;
+		const auto shape = std::clamp(properties.particleShape, 0, 2);
+		return shaders.get({ shape, _antialias ? 1 : 0, static_cast<int>(_instanceFormat), _pointSprites ? 1 : 0 });
+	}
+
+	// attributes 1 (colour) and 2.. of the instance buffer, expects the VAO and instanceVBO bound
+	void setupInstanceLayout(InstanceFormat format)
+	{
+		if (format == InstanceFormat::Compact)
+		{
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)offsetof(InstanceData, color)); gl::checkError();
+			glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)offsetof(InstanceData, positionScale)); gl::checkError();
+			for (auto attribute = 3; attribute <= 5; ++attribute)
+			{
+				glDisableVertexAttribArray(attribute); gl::checkError();
+			}
+		}
 		else
-			return triangleShader;
+		{
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(MatrixInstance), (const void*)offsetof(MatrixInstance, color)); gl::checkError();
+			for (auto column = 0; column < 4; ++column)
+			{
+				const auto attribute = 2 + column;
+				glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, sizeof(MatrixInstance), (const void*)(offsetof(MatrixInstance, transformation) + column * sizeof(glm::vec4))); gl::checkError();
+				glEnableVertexAttribArray(attribute); gl::checkError();
+				glVertexAttribDivisor(attribute, 1); gl::checkError();
+			}
+		}
+
+		glEnableVertexAttribArray(1); gl::checkError();
+		glEnableVertexAttribArray(2); gl::checkError();
+		glVertexAttribDivisor(1, 1); gl::checkError();
+		glVertexAttribDivisor(2, 1); gl::checkError();
+		layoutFormat = format;
 	}
 
 public:
-	InstancedParticleSystem(unsigned int pool, unsigned int width, unsigned int height)
+	explicit InstancedParticleSystem(unsigned int pool)
 		: VAO(gl::genVertexArray())
+		, pointsVAO(gl::genVertexArray())
 		, VBO(gl::genBuffer())
 		, EBO(gl::genBuffer())
 		, instanceVBO(gl::genBuffer())
-		, textureId(gl::genTexture(width, height))
-		, FBO(gl::genFramebuffer(textureId))
-		, circleShader("instanced.vert", "circle.frag")
-		, squareShader("instanced.vert", "square.frag")
-		, triangleShader("instanced.vert", "triangle.frag")
+		, shaders("instanced.vert", "instanced.frag", { { "SHAPE", 3 }, { "ANTIALIAS", 2 }, { "INSTANCE_FORMAT", 2 }, { "POINTS", 2 } })
 		, particlesLimit(pool)
 	{
 		assert(VAO != 0);
@@ -112,6 +135,7 @@ public:
 		};
 
 		instancesData.resize(pool);
+		particles.reserve(pool);
 
 		glBindVertexArray(VAO); gl::checkError();
 		glBindBuffer(GL_ARRAY_BUFFER, VBO); gl::checkError();
@@ -123,111 +147,176 @@ public:
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (const void*)0); gl::checkError();
 		glEnableVertexAttribArray(0); gl::checkError();
 
+		// sized for the larger format so switching formats never reallocates
 		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO); gl::checkError();
-		glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * particlesLimit, nullptr, GL_DYNAMIC_DRAW); gl::checkError();
+		glBufferData(GL_ARRAY_BUFFER, sizeof(MatrixInstance) * particlesLimit, nullptr, GL_DYNAMIC_DRAW); gl::checkError();
+		setupInstanceLayout(_instanceFormat);
 
-		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)(0 * sizeof(glm::vec4))); gl::checkError();
+		// the same compact instances, one vertex each
+		glBindVertexArray(pointsVAO); gl::checkError();
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)offsetof(InstanceData, color)); gl::checkError();
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)offsetof(InstanceData, positionScale)); gl::checkError();
 		glEnableVertexAttribArray(1); gl::checkError();
-
-		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)(1 * sizeof(glm::vec4))); gl::checkError();
 		glEnableVertexAttribArray(2); gl::checkError();
 
-		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)(2 * sizeof(glm::vec4))); gl::checkError();
-		glEnableVertexAttribArray(3); gl::checkError();
-
-		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)(3 * sizeof(glm::vec4))); gl::checkError();
-		glEnableVertexAttribArray(4); gl::checkError();
-
-		glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)(4 * sizeof(glm::vec4))); gl::checkError();
-		glEnableVertexAttribArray(5); gl::checkError();
-
-		glVertexAttribDivisor(1, 1); gl::checkError();
-		glVertexAttribDivisor(2, 1); gl::checkError();
-		glVertexAttribDivisor(3, 1); gl::checkError();
-		glVertexAttribDivisor(4, 1); gl::checkError();
-		glVertexAttribDivisor(5, 1); gl::checkError();
-
 		glBindBuffer(GL_ARRAY_BUFFER, 0); gl::checkError();
 		glBindVertexArray(0); gl::checkError();
+
+		gl::label(GL_VERTEX_ARRAY, VAO, "particles");
+		gl::label(GL_VERTEX_ARRAY, pointsVAO, "particle points");
+		gl::label(GL_BUFFER, instanceVBO, "particle instances");
 	}
 
-	~InstancedParticleSystem()
+	// view/projection come from the Camera uniform block (CameraBuffer)
+	void draw(float currentTime, GLuint framebuffer)
 	{
-		glDeleteFramebuffers(1, &FBO); gl::checkError();
+		// draws the particles where they were before this frame's step
+		fill(currentTime);
+		update(currentTime);
+		upload();
+		render(framebuffer);
+	}
 
-		glDeleteTextures(1, &textureId); gl::checkError();
+	// what fill() projects particle sizes with, the camera of the next draw and the height of its target
+	void lodCamera(const glm::mat4& view, const glm::mat4& projection, float viewportHeight)
+	{
+		viewDepth = -glm::vec4{ view[0][2], view[1][2], view[2][2], view[3][2] };
+		pixelsPerUnit = projection[1][1] * viewportHeight; // a quad is 2 * scale wide
+	}
 
-		unsigned buffers[] = { instanceVBO, EBO, VBO };
-		glDeleteBuffers(3, buffers); gl::checkError();
+	// stages of draw() exposed separately so they can be measured on their own
+	void update(float currentTime)
+	{
+		PROFILE_CPU_SCOPE("particles update");
 
-		glDeleteVertexArrays(1, &VAO); gl::checkError();
+		// integrate and compact in one pass, survivors keep their order
+		auto alive = std::size_t{ 0 };
+		for (auto i = std::size_t{ 0 }; i < particles.size(); ++i)
+		{
+			const auto particleLifetime = currentTime - particles.creationTime[i];
+			if (particleLifetime < particles.totalLifeTime[i])
+			{
+				particles.position[i] += particles.velocity[i];
+				particles.velocity[i] += particles.acceleration[i];
+				if (alive != i)
+					particles.move(i, alive);
+				alive++;
+			}
+		}
+		particles.resize(alive);
 	}
 
-	void draw(glm::mat4 view, glm::mat4 projection, float currentTime)
+	void fill(float currentTime)
 	{
-		if (aliveParticles.empty())
-			return;
+		PROFILE_CPU_SCOPE("particles fill");
 
-		auto instanceIndex = std::size_t{ 0 };
-		for (auto particle = aliveParticles.begin(); particle != aliveParticles.end(); particle++)
+		// one switch for the whole draw, splitting it would reorder the instances the exporter reads
+		const auto measure = _pointSpritesBelow > 0.f && pixelsPerUnit > 0.f && _instanceFormat == InstanceFormat::Compact;
+		auto largest = 0.f; // scale / depth
+
+		instancesCount = 0;
+		for (auto i = std::size_t{ 0 }; i < particles.size(); ++i)
 		{
-			const auto particleLifetime = currentTime - particle->creationTime;
-			particle->isAlive = particleLifetime < particle->totalLifeTime;
+			const auto particleLifetime = currentTime - particles.creationTime[i];
+			if (particleLifetime >= particles.totalLifeTime[i])
+				continue; // update() drops it this frame
+			const auto progress = particleLifetime / particles.totalLifeTime[i];
+
+			auto& instanceData = instancesData[instancesCount++];
+			instanceData.color = glm::lerp(particles.startColor[i], particles.endColor[i], progress);
+			instanceData.positionScale = glm::vec4{ particles.position[i], particles.scale[i] };
+		}
 
-			if (particle->isAlive)
+		if (measure)
+		{
+			// branchless over the columns it reads, behind the camera is clipped anyway
+			for (auto i = std::size_t{ 0 }; i < particles.size(); ++i)
 			{
-				const auto progress = particleLifetime / particle->totalLifeTime;
+				const auto& position = particles.position[i];
+				const auto depth = viewDepth.x * position.x + viewDepth.y * position.y + viewDepth.z * position.z + viewDepth.w;
+				const auto size = particles.scale[i] / depth;
+				const auto alive = currentTime - particles.creationTime[i] < particles.totalLifeTime[i];
+				largest = alive && depth > 0.f && size > largest ? size : largest;
+			}
+		}
 
-				// translation like this is a lot faster than using glm::translate on eye matrix
-				auto transformation = glm::mat4(glm::vec4{ particle->scale, 0.f, 0.f, 0.f },
-											    glm::vec4{ 0.f, particle->scale, 0.f, 0.f },
-											    glm::vec4{ 0.f, 0.f, particle->scale, 0.f },
-											    glm::vec4{ particle->position, 1.f });
+		_projectedSize = largest * pixelsPerUnit;
+		_pointSprites = measure && instancesCount != 0 && _projectedSize < _pointSpritesBelow;
 
+		if (_instanceFormat == InstanceFormat::Matrix)
+		{
+			matrixData.resize(particlesLimit);
+			for (auto i = std::size_t{ 0 }; i < instancesCount; ++i)
+			{
+				const auto& instance = instancesData[i];
+				const auto scale = instance.positionScale.w;
+
+				// translation like this is a lot faster than using glm::translate on eye matrix
 				// TODO slow af, try quaternions
 				//transformation = glm::rotate(transformation, zRotation, glm::vec3{ 0.f, 0.f, 1.f });
-				//transformation = glm::scale(transformation, glm::vec3{ particle->scale, particle->scale, particle->scale });
-
-				auto& instanceData = instancesData[instanceIndex++];
-				instanceData.color = glm::lerp(particle->startColor, particle->endColor, progress);
-				instanceData.transformation = transformation;
-
-				particle->position += particle->velocity;
-				particle->velocity += particle->acceleration;
+				matrixData[i].color = instance.color;
+				matrixData[i].transformation = glm::mat4(glm::vec4{ scale, 0.f, 0.f, 0.f },
+														 glm::vec4{ 0.f, scale, 0.f, 0.f },
+														 glm::vec4{ 0.f, 0.f, scale, 0.f },
+														 glm::vec4{ glm::vec3(instance.positionScale), 1.f });
 			}
 		}
-		aliveParticles.remove_if([](const auto& p) { return !p.isAlive; });
+	}
 
-		auto& shader = getShader();
+	void upload()
+	{
+		PROFILE_SCOPE("particles upload");
+		const auto debugGroup = gl::DebugGroup("particles upload");
 
-		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-		gl::checkError();
+		if (instancesCount == 0)
+			return;
 
-		glClearColor(0.f, 0.f, 0.f, 0.f);
+		const auto matrix = _instanceFormat == InstanceFormat::Matrix;
+		const auto dataSize = (matrix ? sizeof(MatrixInstance) : sizeof(InstanceData)) * instancesCount;
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
 		gl::checkError();
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, dataSize, matrix ? static_cast<const void*>(matrixData.data()) : instancesData.data());
 		gl::checkError();
+	}
 
-		shader.use();
-		shader.setMat4("view", view);
-		shader.setMat4("projection", projection);
-		shader.setFloat("thickness", properties.shapeThickness);
+	// clears the framebuffer (a color target from the pool) and draws the particles into it
+	void render(GLuint framebuffer)
+	{
+		PROFILE_SCOPE("particles render");
+		const auto debugGroup = gl::DebugGroup("particles render");
 
-		const auto dataSize = sizeof(InstanceData) * instanceIndex;
-		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-		gl::checkError();
-		glBufferSubData(GL_ARRAY_BUFFER, 0, dataSize, instancesData.data());
-		gl::checkError();
+		auto& shader = getShader();
 
-		glBindVertexArray(VAO);
+		gl::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glClearColor(0.f, 0.f, 0.f, 0.f);
 		gl::checkError();
-		glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr, instanceIndex);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		gl::checkError();
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		gl::checkError();
-		//glUseProgram(0);
-		//gl::checkError();
+		if (instancesCount != 0 && _pointSprites)
+		{
+			shader.use();
+			shader.setFloat("thickness", properties.shapeThickness);
+
+			gl::enable(GL_PROGRAM_POINT_SIZE);
+			gl::bindVertexArray(pointsVAO);
+			glDrawArrays(GL_POINTS, 0, instancesCount);
+			gl::checkError();
+		}
+		else if (instancesCount != 0)
+		{
+			shader.use();
+			shader.setFloat("thickness", properties.shapeThickness);
+
+			gl::bindVertexArray(VAO);
+			if (layoutFormat != _instanceFormat)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, instanceVBO); gl::checkError();
+				setupInstanceLayout(_instanceFormat);
+			}
+			glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr, instancesCount);
+			gl::checkError();
+		}
 	}
 
 	auto& startColor() { return properties.startColor; }
@@ -235,15 +324,53 @@ public:
 	auto& totalLifetimeSeconds() { return properties.totalLifetimeSeconds; }
 	auto& spawnCount() { return properties.spawnCount; }
 	auto& scale() { return properties.scale; }
-	auto aliveParticlesCount() { return aliveParticles.size(); }
+	auto aliveParticlesCount() { return particles.size(); }
 	auto& particleShape() { return properties.particleShape; }
 	auto& shapeThickness() { return properties.shapeThickness; }
 	auto& initialVelocity() { return properties.initialVelocity; }
 	auto& acceleration() { return properties.acceleration; }
 	auto& randomVelocity() { return properties.randomVelocity; }
 	auto& randomAcceleration() { return properties.randomAcceleration; }
+	auto& props() { return properties; }
+	auto& antialias() { return _antialias; }
+	auto& instanceFormat() { return _instanceFormat; }
+	auto& pointSpritesBelow() { return _pointSpritesBelow; }
+	float projectedSize() const { return _projectedSize; } // 0 when not measured
+	bool pointSprites() const { return _pointSprites; } // the last fill() picked them
+	auto compiledVariants() const { return shaders.compiled(); }
+	auto& store() { return particles; }
+	const auto& store() const { return particles; }
+	auto poolSize() const { return particlesLimit; }
+
+	// instances written by the last fill(), the exporter reads colours and positions from here
+	const auto* instances() const { return instancesData.data(); }
+	auto instanceCount() const { return instancesCount; }
+
+	// FNV-1a over the simulated state, used to check that a replay reproduces a recording bit for bit
+	std::uint64_t stateHash() const
+	{
+		auto hash = std::uint64_t{ 14695981039346656037ull };
+		const auto add = [&hash](const auto& value)
+		{
+			const auto* bytes = reinterpret_cast<const unsigned char*>(&value);
+			for (auto i = std::size_t{ 0 }; i < sizeof(value); ++i)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+		};
 
-	auto texture() { return textureId; }
+		for (auto i = std::size_t{ 0 }; i < particles.size(); ++i)
+		{
+			add(particles.position[i]);
+			add(particles.velocity[i]);
+			add(particles.acceleration[i]);
+			add(particles.startColor[i]);
+			add(particles.endColor[i]);
+			add(particles.creationTime[i]);
+			add(particles.totalLifeTime[i]);
+			add(particles.rotationSpeed[i]);
+			add(particles.scale[i]);
+		}
+		return hash;
+	}
 
 	void emit(glm::vec3 worldPos, float t)
 	{
@@ -264,34 +391,21 @@ public:
 
 		for (auto i = 0; i < spawnCount; i++)
 		{
-			if (aliveParticles.size() >= particlesLimit)
+			if (particles.size() >= particlesLimit)
 			{
 				std::cerr << "All particles are alive." << std::endl;
 				return; // cannot emit
 			}
 
-			auto particle = Particle{};
-			particle.position = worldPos;
-			particle.velocity = randomVelocity ? glm::vec3{ rng::Float(), rng::Float(), rng::Float() } : initialVelocity;
-			particle.acceleration = randomAcceleration ? glm::vec3{ rng::Float() / 10.f, rng::Float() / 10.f, rng::Float() / 10.f } : acceleration;
-			particle.creationTime = t;
-			particle.totalLifeTime = totalLifetimeSeconds;
-			particle.rotationSpeed = rng::Float() * 10000;
-			particle.startColor = startColor;
-			particle.endColor = endColor;
-			particle.scale = scale;
-			particle.isAlive = true;
-			aliveParticles.push_back(particle);
+			particles.position.push_back(worldPos);
+			particles.velocity.push_back(randomVelocity ? glm::vec3{ rng::Float(), rng::Float(), rng::Float() } : initialVelocity);
+			particles.acceleration.push_back(randomAcceleration ? glm::vec3{ rng::Float() / 10.f, rng::Float() / 10.f, rng::Float() / 10.f } : acceleration);
+			particles.creationTime.push_back(t);
+			particles.totalLifeTime.push_back(totalLifetimeSeconds);
+			particles.rotationSpeed.push_back(rng::Float() * 10000);
+			particles.startColor.push_back(startColor);
+			particles.endColor.push_back(endColor);
+			particles.scale.push_back(scale);
 		}
 	}
-
-	void resize(unsigned int width, unsigned int height)
-	{
-		glBindTexture(GL_TEXTURE_2D, textureId);
-		gl::checkError();
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-		gl::checkError();
-		glBindTexture(GL_TEXTURE_2D, textureId);
-		gl::checkError();
-	}
 };
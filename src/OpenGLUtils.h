@@ -2,16 +2,49 @@
 
 #include <glad/glad.h>
 
+#include <cstdint>
 #include <string>
 #include <stdexcept>
 
 namespace gl
 {
-	void glCheckError_(const char* file, int line)
+	// driver calls made through the wrappers, the caller resets them every frame
+	struct CallCounters
+	{
+		std::uint64_t getUniformLocation = 0;
+		std::uint64_t uniform = 0;
+		std::uint64_t bufferUpload = 0;
+		std::uint64_t getError = 0;
+		std::uint64_t debugMessages = 0; // reported by the KHR_debug callback (GLDebug.h)
+		std::uint64_t stateIssued = 0; // binds and enables that went through the state cache (GLState.h)
+		std::uint64_t stateSkipped = 0; // ... and the ones it dropped as redundant
+	};
+
+	CallCounters& counters()
+	{
+		static auto counters = CallCounters{};
+		return counters;
+	}
+
+	// How GL errors are found: glGetError after every wrapped call, the KHR_debug callback (GLDebug.h) with one
+	// glGetError per frame, only the glGetError per frame, or not at all. checkError() only polls in Call mode,
+	// checkFrameErrors() in Debug and Frame mode.
+	enum class ErrorChecks { Call, Debug, Frame, Off };
+
+	ErrorChecks& errorChecks()
+	{
+#ifdef NDEBUG
+		static auto mode = ErrorChecks::Off;
+#else
+		static auto mode = ErrorChecks::Call;
+#endif
+		return mode;
+	}
+
+	void throwErrors(const std::string& where)
 	{
-#ifndef NDEBUG
 		GLenum errorCode;
-		while ((errorCode = glGetError()) != GL_NO_ERROR)
+		while (counters().getError++, (errorCode = glGetError()) != GL_NO_ERROR)
 		{
 			std::string error;
 			switch (errorCode)
@@ -24,9 +57,21 @@ namespace gl
 			case GL_OUT_OF_MEMORY:                 error = "OUT_OF_MEMORY"; break;
 			case GL_INVALID_FRAMEBUFFER_OPERATION: error = "INVALID_FRAMEBUFFER_OPERATION"; break;
 			}
-			throw std::runtime_error(error + " | " + std::string(file) + " (" + std::to_string(line) + ")");
+			throw std::runtime_error(error + " | " + where);
 		}
-#endif
+	}
+
+	void glCheckError_(const char* file, int line)
+	{
+		if (errorChecks() == ErrorChecks::Call)
+			throwErrors(std::string(file) + " (" + std::to_string(line) + ")");
+	}
+
+	// once per frame, after the frame has been submitted
+	void checkFrameErrors()
+	{
+		if (errorChecks() == ErrorChecks::Debug || errorChecks() == ErrorChecks::Frame)
+			throwErrors("end of frame");
 	}
 #define checkError() glCheckError_(__FILE__, __LINE__) 
 
@@ -46,8 +91,31 @@ namespace gl
 		return buffer;
 	}
 
-	GLuint genTexture(unsigned int width, unsigned int height)
+	// what glTexImage2D needs besides the sized internal format
+	struct TextureFormat
+	{
+		GLenum format;
+		GLenum type;
+		unsigned int bytesPerPixel;
+	};
+
+	TextureFormat textureFormat(GLenum internalFormat)
 	{
+		switch (internalFormat)
+		{
+		case GL_RGB8: return { GL_RGB, GL_UNSIGNED_BYTE, 3 };
+		case GL_RGBA8: return { GL_RGBA, GL_UNSIGNED_BYTE, 4 };
+		// float: values above 1 survive to the tonemapper
+		case GL_R11F_G11F_B10F: return { GL_RGB, GL_FLOAT, 4 }; // no sign, 6/6/5 bit mantissas
+		case GL_RGBA16F: return { GL_RGBA, GL_HALF_FLOAT, 8 };
+		default: throw std::runtime_error("Unsupported texture format " + std::to_string(internalFormat));
+		}
+	}
+
+	GLuint genTexture(unsigned int width, unsigned int height, GLenum internalFormat = GL_RGB8, GLenum filter = GL_NEAREST)
+	{
+		const auto [format, type, bytesPerPixel] = textureFormat(internalFormat);
+
 		auto texture = GLuint{ 0 };
 		glGenTextures(1, &texture);
 		gl::checkError();
@@ -55,11 +123,11 @@ namespace gl
 		glBindTexture(GL_TEXTURE_2D, texture);
 		gl::checkError();
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
 		gl::checkError();
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		gl::checkError();
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+// command line of the particles executable
+struct Options
+{
+	std::string tracePath; // capture a Chrome trace at startup when set
+	int traceFrames = 600;
+
+	std::string recordPath; // record input and emission to this file
+	std::string replayPath; // replay a recording instead of live input
+	bool headless = false; // replay offscreen at maximum speed
+	float fixedDelta = 0.f; // fixed simulation step in seconds, 0 = wall clock
+	std::optional<std::uint32_t> seed;
+
+	std::string snapshotPath; // restore this snapshot before the first frame
+
+	std::string exportPath; // stream particles of every exportEvery-th frame to this file
+	unsigned int exportEvery = 1;
+	bool exportQuantize = false;
+	bool exportDelta = false;
+
+	std::string capturePath; // capture the composited frames, format from captureFormat or the extension
+	std::string captureFormat;
+	unsigned int width = 0, height = 0; // headless render size, 0 = window size
+
+	std::string shaderCache = "shader_cache"; // directory of cached program binaries, empty = disabled
+	std::string assetsPath; // loose assets instead of the embedded ones, also PARTICLES_ASSETS
+
+	std::string glErrors; // call|debug|frame|off, empty = debug in debug builds, off in release builds
+
+	static Options parse(int argc, char** argv)
+	{
+		auto options = Options{};
+		for (auto i = 1; i < argc; ++i)
+		{
+			const auto arg = std::string(argv[i]);
+			const auto next = [&]() -> std::string
+			{
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing value for " + arg);
+				return argv[++i];
+			};
+
+			if (arg == "--trace")
+				options.tracePath = next();
+			else if (arg == "--trace-frames")
+				options.traceFrames = std::stoi(next());
+			else if (arg == "--record")
+				options.recordPath = next();
+			else if (arg == "--replay")
+				options.replayPath = next();
+			else if (arg == "--headless")
+				options.headless = true;
+			else if (arg == "--fixed-dt")
+				options.fixedDelta = std::stof(next());
+			else if (arg == "--seed")
+				options.seed = static_cast<std::uint32_t>(std::stoul(next()));
+			else if (arg == "--snapshot")
+				options.snapshotPath = next();
+			else if (arg == "--export")
+				options.exportPath = next();
+			else if (arg == "--export-every")
+				options.exportEvery = std::stoul(next());
+			else if (arg == "--export-quantize")
+				options.exportQuantize = true;
+			else if (arg == "--export-delta")
+				options.exportQuantize = options.exportDelta = true;
+			else if (arg == "--capture")
+				options.capturePath = next();
+			else if (arg == "--capture-format")
+				options.captureFormat = next();
+			else if (arg == "--size")
+			{
+				const auto size = next();
+				const auto comma = size.find(',');
+				if (comma == std::string::npos)
+					throw std::runtime_error("--size expects WIDTH,HEIGHT");
+				options.width = std::stoul(size.substr(0, comma));
+				options.height = std::stoul(size.substr(comma + 1));
+			}
+			else if (arg == "--shader-cache")
+				options.shaderCache = next();
+			else if (arg == "--no-shader-cache")
+				options.shaderCache.clear();
+			else if (arg == "--assets")
+				options.assetsPath = next();
+			else if (arg == "--gl-errors")
+				options.glErrors = next();
+			else if (arg == "--help")
+			{
+				std::cout << "usage: particles [--trace FILE] [--trace-frames N]\n"
+							 "                 [--record FILE] [--fixed-dt SECONDS] [--seed N]\n"
+							 "                 [--replay FILE] [--headless] [--snapshot FILE]\n"
+							 "                 [--export FILE] [--export-every N] [--export-quantize] [--export-delta]\n"
+							 "                 [--capture PATH] [--capture-format raw|png|y4m] [--size W,H]\n"
+							 "                 [--shader-cache DIR] [--no-shader-cache] [--assets DIR]\n"
+							 "                 [--gl-errors call|debug|frame|off]\n"
+							 "--headless --replay FILE --capture PATH renders every frame offline without drops\n"
+							 "--gl-errors: glGetError after every call, KHR_debug messages plus glGetError once per frame (default in\n"
+							 "             debug builds), glGetError once per frame, or no checks (default in release builds)\n";
+				std::exit(EXIT_SUCCESS);
+			}
+			else
+				throw std::runtime_error("Unknown argument: " + arg);
+		}
+
+		if (!options.recordPath.empty() && !options.replayPath.empty())
+			throw std::runtime_error("--record and --replay are exclusive");
+		if (options.seed && !options.replayPath.empty())
+			throw std::runtime_error("--seed cannot be combined with --replay, replays use the recorded seed");
+		if (!options.snapshotPath.empty() && (!options.recordPath.empty() || !options.replayPath.empty()))
+			throw std::runtime_error("--snapshot cannot be combined with --record or --replay");
+
+		return options;
+	}
+};
@@ -0,0 +1,351 @@
+#pragma once
+
+#include "Profiler.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams particle positions and colours of every Nth simulation frame to disk for offline analysis.
+//
+// layout (little endian):
+//   FileHeader
+//   per exported frame: ChunkHeader, then 7 columns (x, y, z, r, g, b, a), each as uint64 byte size + data
+// Column encodings, by FileHeader::flags:
+//   none        float32 per value
+//   QUANTIZED   positions uint16 normalised to the chunk bounds, colours uint8
+//   DELTA       (needs QUANTIZED) difference to the previous particle in the column, zigzag, LEB128 varint
+// Particles keep their emission order, so neighbours in a column are mostly from the same burst and deltas stay small.
+namespace exporter
+{
+	constexpr auto MAGIC = std::uint32_t{ 0x50584550 }; // "PEXP"
+	constexpr auto CHUNK_MAGIC = std::uint32_t{ 0x4b4e4843 }; // "CHNK"
+	constexpr auto VERSION = std::uint32_t{ 1 };
+
+	enum Flags : std::uint32_t
+	{
+		QUANTIZED = 1 << 0,
+		DELTA = 1 << 1
+	};
+
+	struct FileHeader
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t flags;
+		std::uint32_t every;
+	};
+
+	struct ChunkHeader
+	{
+		std::uint32_t magic;
+		std::uint32_t count;
+		std::uint64_t frame;
+		float simTime;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		std::uint32_t columns;
+	};
+
+	static_assert(sizeof(FileHeader) == 16);
+	static_assert(sizeof(ChunkHeader) == 48);
+
+	// Bounded single producer / single consumer queue of preallocated slots. The frame data only goes through the
+	// ring: the render thread fills the slot at `head` and publishes it, the writer releases slots from `tail`. The
+	// exporter's mutex only guards the writer's wake-up.
+	template<class T, std::size_t N>
+	class SpscRing final
+	{
+		static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+		std::array<T, N> slots;
+		alignas(64) std::atomic<std::size_t> head = 0; // next slot to fill, written by the producer
+		alignas(64) std::atomic<std::size_t> tail = 0; // next slot to drain, written by the consumer
+
+	public:
+		// producer: free slot or nullptr when the consumer is N slots behind
+		T* acquire()
+		{
+			const auto h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) == N)
+				return nullptr;
+			return &slots[h % N];
+		}
+
+		void publish() { head.fetch_add(1, std::memory_order_release); }
+
+		// consumer: oldest published slot or nullptr when empty
+		T* front()
+		{
+			const auto t = tail.load(std::memory_order_relaxed);
+			if (t == head.load(std::memory_order_acquire))
+				return nullptr;
+			return &slots[t % N];
+		}
+
+		void release() { tail.fetch_add(1, std::memory_order_release); }
+
+		bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+	};
+
+	class ParticleExporter final
+	{
+		static constexpr std::size_t QUEUE_SIZE = 4;
+
+		static constexpr auto COLUMNS = 7; // x, y, z, r, g, b, a
+
+		// already split into columns by the producer so the encoder only walks plain float arrays
+		struct Frame
+		{
+			std::uint64_t index = 0;
+			float simTime = 0.f;
+			std::size_t count = 0;
+			std::array<std::vector<float>, COLUMNS> columns;
+		};
+
+		const std::uint32_t flags;
+		const std::uint32_t every;
+		std::ofstream file;
+		SpscRing<Frame, QUEUE_SIZE> queue;
+		std::vector<char> chunk; // encoding scratch, reused between frames
+
+		std::uint64_t frameCounter = 0;
+		std::atomic<bool> stopping = false;
+		// only for sleeping, the frames themselves go through the lock-free ring
+		std::mutex mutex;
+		std::condition_variable frameAvailable;
+		std::atomic<std::size_t> _exported = 0, _dropped = 0;
+		std::atomic<std::uint64_t> _bytes = 0;
+		std::atomic<float> _encodeMs = 0.f;
+		std::thread writer;
+
+		template<class T>
+		void put(const T& value)
+		{
+			const auto* bytes = reinterpret_cast<const char*>(&value);
+			chunk.insert(chunk.end(), bytes, bytes + sizeof(T));
+		}
+
+		static char* putVarint(char* out, std::uint32_t value)
+		{
+			while (value >= 0x80)
+			{
+				*out++ = static_cast<char>((value & 0x7f) | 0x80);
+				value >>= 7;
+			}
+			*out++ = static_cast<char>(value);
+			return out;
+		}
+
+		// quantize(value) maps a float of the column to what is stored
+		template<class Value, class Quantize>
+		void putColumn(const float* values, std::size_t count, Quantize&& quantize)
+		{
+			const auto sizeOffset = chunk.size();
+			put(std::uint64_t{ 0 });
+
+			if (flags & DELTA)
+			{
+				// worst case 3 varint bytes per value (deltas of 16 bit values), trimmed afterwards
+				const auto begin = chunk.size();
+				chunk.resize(begin + count * 3);
+				auto* out = chunk.data() + begin;
+				auto previous = std::int32_t{ 0 };
+				for (auto i = std::size_t{ 0 }; i < count; ++i)
+				{
+					const auto value = static_cast<std::int32_t>(quantize(values[i]));
+					const auto delta = value - previous;
+					previous = value;
+					out = putVarint(out, (static_cast<std::uint32_t>(delta) << 1) ^ static_cast<std::uint32_t>(delta >> 31));
+				}
+				chunk.resize(out - chunk.data());
+			}
+			else
+			{
+				const auto begin = chunk.size();
+				chunk.resize(begin + count * sizeof(Value));
+				auto* out = reinterpret_cast<Value*>(chunk.data() + begin);
+				for (auto i = std::size_t{ 0 }; i < count; ++i)
+					out[i] = static_cast<Value>(quantize(values[i]));
+			}
+
+			const auto size = static_cast<std::uint64_t>(chunk.size() - sizeOffset - sizeof(std::uint64_t));
+			std::memcpy(chunk.data() + sizeOffset, &size, sizeof(size));
+		}
+
+		void encode(const Frame& frame)
+		{
+			PROFILE_CPU_SCOPE("export encode");
+
+			const auto count = frame.count;
+
+			auto header = ChunkHeader{};
+			header.magic = CHUNK_MAGIC;
+			header.count = static_cast<std::uint32_t>(count);
+			header.frame = frame.index;
+			header.simTime = frame.simTime;
+			header.columns = COLUMNS;
+			for (auto axis = 0; axis < 3 && count; ++axis)
+			{
+				const auto& column = frame.columns[axis];
+				const auto [min, max] = std::minmax_element(column.begin(), column.begin() + count);
+				header.boundsMin[axis] = *min;
+				header.boundsMax[axis] = *max;
+			}
+
+			chunk.clear();
+			put(header);
+
+			for (auto axis = 0; axis < 3; ++axis)
+			{
+				const auto* values = frame.columns[axis].data();
+				if (flags & QUANTIZED)
+				{
+					const auto from = header.boundsMin[axis];
+					const auto range = header.boundsMax[axis] - from;
+					const auto scale = range > 0.f ? 65535.f / range : 0.f;
+					putColumn<std::uint16_t>(values, count, [from, scale](float value) { return static_cast<std::int32_t>((value - from) * scale + 0.5f); });
+				}
+				else
+					putColumn<float>(values, count, [](float value) { return value; });
+			}
+
+			for (auto channel = 3; channel < COLUMNS; ++channel)
+			{
+				const auto* values = frame.columns[channel].data();
+				if (flags & QUANTIZED)
+					putColumn<std::uint8_t>(values, count, [](float value) { return static_cast<std::int32_t>(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f); });
+				else
+					putColumn<float>(values, count, [](float value) { return value; });
+			}
+		}
+
+		void run()
+		{
+			profiler::threadBuffer("particle export");
+
+			while (true)
+			{
+				auto* frame = queue.front();
+				if (!frame)
+				{
+					if (stopping.load(std::memory_order_acquire) && queue.empty())
+						break;
+					auto lock = std::unique_lock(mutex);
+					frameAvailable.wait(lock, [this] { return stopping.load(std::memory_order_acquire) || !queue.empty(); });
+					continue;
+				}
+
+				const auto start = std::chrono::steady_clock::now();
+				encode(*frame);
+				queue.release(); // the frame is no longer needed once encoded, let the producer reuse the slot
+
+				{
+					PROFILE_CPU_SCOPE("export write");
+					file.write(chunk.data(), chunk.size());
+				}
+
+				_encodeMs.store(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+				_bytes.fetch_add(chunk.size(), std::memory_order_relaxed);
+				_exported.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			file.flush();
+		}
+
+	public:
+		ParticleExporter(const std::filesystem::path& path, unsigned int every, bool quantize, bool delta)
+			: flags((quantize ? std::uint32_t{ QUANTIZED } : 0u) | (delta ? std::uint32_t{ DELTA } : 0u))
+			, every(std::max(every, 1u))
+			, file(path, std::ios::binary)
+		{
+			if (!file.is_open())
+				throw std::runtime_error("Could not open file:" + path.string());
+			if (delta && !quantize)
+				throw std::runtime_error("Delta encoding needs quantisation");
+
+			const auto header = FileHeader{ MAGIC, VERSION, flags, this->every };
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+			writer = std::thread([this] { run(); });
+		}
+
+		~ParticleExporter()
+		{
+			{
+				const auto lock = std::lock_guard(mutex);
+				stopping.store(true, std::memory_order_release);
+			}
+			frameAvailable.notify_one();
+			writer.join();
+		}
+
+		ParticleExporter(const ParticleExporter&) = delete;
+		ParticleExporter& operator=(const ParticleExporter&) = delete;
+
+		// Call once per simulation frame after the particle system filled its instances. Copies every Nth frame into
+		// the queue; when the writer is behind the frame is dropped instead of waiting.
+		template<class ParticleSystem>
+		void frame(const ParticleSystem& particleSystem, float simTime)
+		{
+			if (frameCounter++ % every != 0)
+				return;
+
+			PROFILE_CPU_SCOPE("export copy");
+
+			auto* slot = queue.acquire();
+			if (!slot)
+			{
+				_dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			const auto count = particleSystem.instanceCount();
+			const auto* instances = particleSystem.instances();
+			slot->index = frameCounter - 1;
+			slot->simTime = simTime;
+			slot->count = count;
+			for (auto& column : slot->columns)
+				column.resize(count);
+
+			auto& [x, y, z, r, g, b, a] = slot->columns;
+			for (auto i = std::size_t{ 0 }; i < count; ++i)
+			{
+				const auto& position = instances[i].positionScale;
+				const auto& color = instances[i].color;
+				x[i] = position.x;
+				y[i] = position.y;
+				z[i] = position.z;
+				r[i] = color.x;
+				g[i] = color.y;
+				b[i] = color.z;
+				a[i] = color.w;
+			}
+
+			{
+				// under the lock so the writer can't miss it between checking the ring and going to sleep
+				const auto lock = std::lock_guard(mutex);
+				queue.publish();
+			}
+			frameAvailable.notify_one();
+		}
+
+		std::size_t exported() const { return _exported.load(std::memory_order_relaxed); }
+		std::size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+		std::uint64_t bytes() const { return _bytes.load(std::memory_order_relaxed); }
+		float encodeMs() const { return _encodeMs.load(std::memory_order_relaxed); }
+	};
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// emitter settings shared by all particle systems, exposed through ImGui
+struct ParticleProperties
+{
+	glm::vec3 initialVelocity = { 0.f, 0.f, 0.f };
+	glm::vec3 acceleration = { 0.f, 0.f, 0.f };
+	glm::vec4 startColor = { 0.f, 0.5f, 1.f, 1.f };
+	glm::vec4 endColor = { 1.f, 0.f, 0.f, 1.f };
+	int totalLifetimeSeconds = 5;
+	int spawnCount = 50;
+	float scale = 0.0025f;
+	int particleShape = 1; // 0 - square, 1 - circle // TODO enum or sth (fast impl for imgui exposure)...
+	float shapeThickness = 0.8f;
+	bool randomVelocity = true;
+	bool randomAcceleration = false;
+
+	bool operator==(const ParticleProperties& other) const
+	{
+		return initialVelocity == other.initialVelocity
+			&& acceleration == other.acceleration
+			&& startColor == other.startColor
+			&& endColor == other.endColor
+			&& totalLifetimeSeconds == other.totalLifetimeSeconds
+			&& spawnCount == other.spawnCount
+			&& scale == other.scale
+			&& particleShape == other.particleShape
+			&& shapeThickness == other.shapeThickness
+			&& randomVelocity == other.randomVelocity
+			&& randomAcceleration == other.randomAcceleration;
+	}
+
+	bool operator!=(const ParticleProperties& other) const { return !(*this == other); }
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Live particles as a structure of arrays: one contiguous column per field, in emission order.
+// update/fill only walk the columns they need and a whole column can be copied in one go (snapshots).
+struct ParticleStore final
+{
+	// ids are part of the snapshot format, do not renumber
+	enum class Column : std::uint32_t
+	{
+		Position = 0,
+		Velocity = 1,
+		Acceleration = 2,
+		StartColor = 3,
+		EndColor = 4,
+		CreationTime = 5,
+		TotalLifeTime = 6,
+		RotationSpeed = 7,
+		Scale = 8
+	};
+
+	std::vector<glm::vec3> position;
+	std::vector<glm::vec3> velocity;
+	std::vector<glm::vec3> acceleration;
+	std::vector<glm::vec4> startColor;
+	std::vector<glm::vec4> endColor;
+	std::vector<float> creationTime;
+	std::vector<float> totalLifeTime;
+	std::vector<float> rotationSpeed;
+	std::vector<float> scale;
+
+	// calls f(Column, column vector) for every column
+	template<class Function>
+	void forEachColumn(Function&& f)
+	{
+		f(Column::Position, position);
+		f(Column::Velocity, velocity);
+		f(Column::Acceleration, acceleration);
+		f(Column::StartColor, startColor);
+		f(Column::EndColor, endColor);
+		f(Column::CreationTime, creationTime);
+		f(Column::TotalLifeTime, totalLifeTime);
+		f(Column::RotationSpeed, rotationSpeed);
+		f(Column::Scale, scale);
+	}
+
+	template<class Function>
+	void forEachColumn(Function&& f) const
+	{
+		const_cast<ParticleStore&>(*this).forEachColumn([&f](Column id, const auto& column) { f(id, column); });
+	}
+
+	std::size_t size() const { return position.size(); }
+
+	void reserve(std::size_t count)
+	{
+		forEachColumn([count](Column, auto& column) { column.reserve(count); });
+	}
+
+	void resize(std::size_t count)
+	{
+		forEachColumn([count](Column, auto& column) { column.resize(count); });
+	}
+
+	// moves particle `from` into slot `to`, used by the compaction in update
+	void move(std::size_t from, std::size_t to)
+	{
+		forEachColumn([from, to](Column, auto& column) { column[to] = column[from]; });
+	}
+};
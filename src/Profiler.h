@@ -0,0 +1,459 @@
+#pragma once
+
+#include "OpenGLUtils.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Hierarchical CPU/GPU frame profiler.
+// CPU scopes are recorded with nanosecond resolution into per-thread single-producer rings (no locks on the hot path),
+// GPU scopes use GL_TIMESTAMP query pairs read back a few frames later so the CPU never waits for the GPU.
+// Everything is a no-op while no Profiler instance exists (e.g. in the benchmark).
+namespace profiler
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	struct Event
+	{
+		const char* name; // string literals only, scopes don't copy names
+		std::int64_t begin, end; // ns, CPU clock (GPU events are converted)
+		std::uint32_t depth;
+		std::uint32_t track; // thread index, GPU_TRACK for GPU events
+	};
+
+	constexpr auto GPU_TRACK = std::uint32_t{ 0xffffffff };
+
+	class ThreadBuffer final
+	{
+		static constexpr std::size_t CAPACITY = 4096; // power of two
+		std::array<Event, CAPACITY> events;
+		std::atomic<std::size_t> head = 0, tail = 0;
+
+	public:
+		const std::uint32_t track;
+		const std::string name;
+		std::uint32_t depth = 0; // touched by the owning thread only
+		std::atomic<std::size_t> dropped = 0;
+
+		ThreadBuffer(std::uint32_t track, std::string name) : track(track), name(std::move(name)) {}
+
+		// owning thread
+		void push(const Event& event)
+		{
+			const auto h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) == CAPACITY)
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			events[h & (CAPACITY - 1)] = event;
+			head.store(h + 1, std::memory_order_release);
+		}
+
+		// collecting thread
+		template<class Function>
+		void drain(Function&& function)
+		{
+			auto t = tail.load(std::memory_order_relaxed);
+			const auto h = head.load(std::memory_order_acquire);
+			for (; t != h; ++t)
+				function(events[t & (CAPACITY - 1)]);
+			tail.store(t, std::memory_order_release);
+		}
+	};
+
+	// Buffers are registered once per thread and never freed, so the owning thread can keep a raw pointer.
+	class Registry final
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+	public:
+		static Registry& get()
+		{
+			static auto registry = Registry{};
+			return registry;
+		}
+
+		ThreadBuffer& add(std::string name)
+		{
+			const auto lock = std::lock_guard(mutex);
+			const auto track = static_cast<std::uint32_t>(buffers.size());
+			buffers.push_back(std::make_unique<ThreadBuffer>(track, name.empty() ? "thread " + std::to_string(track) : std::move(name)));
+			return *buffers.back();
+		}
+
+		template<class Function>
+		void forEach(Function&& function)
+		{
+			const auto lock = std::lock_guard(mutex);
+			for (auto& buffer : buffers)
+				function(*buffer);
+		}
+	};
+
+	ThreadBuffer& threadBuffer(std::string name = {})
+	{
+		thread_local auto& buffer = Registry::get().add(std::move(name));
+		return buffer;
+	}
+
+	class GpuTimers final
+	{
+	public:
+		static constexpr std::size_t FRAMES_IN_FLIGHT = 4;
+		static constexpr std::size_t READBACK_DELAY = FRAMES_IN_FLIGHT - 1;
+
+	private:
+		static constexpr std::size_t MAX_SCOPES = 256;
+
+		struct Scope
+		{
+			const char* name;
+			std::uint32_t depth;
+		};
+
+		struct FrameQueries
+		{
+			std::array<GLuint, MAX_SCOPES * 2> queries;
+			std::vector<Scope> scopes;
+			std::uint64_t frame = 0;
+			bool pending = false;
+		};
+
+		std::array<FrameQueries, FRAMES_IN_FLIGHT> ring;
+		std::size_t current = 0;
+		std::uint32_t depth = 0;
+
+		// GPU timestamps have their own epoch, mapped onto the CPU clock with a periodic calibration
+		std::int64_t gpuToCpuOffset = 0;
+		std::uint64_t calibratedFrame = 0;
+
+		void calibrate()
+		{
+			auto gpuTime = GLint64{ 0 };
+			glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+			gl::checkError();
+			gpuToCpuOffset = now() - gpuTime;
+		}
+
+	public:
+		GpuTimers()
+		{
+			for (auto& frame : ring)
+			{
+				glGenQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+				gl::checkError();
+				frame.scopes.reserve(MAX_SCOPES);
+			}
+			calibrate();
+		}
+
+		GpuTimers(const GpuTimers&) = delete;
+		GpuTimers& operator=(const GpuTimers&) = delete;
+
+		~GpuTimers()
+		{
+			for (auto& frame : ring)
+			{
+				glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+				gl::checkError();
+			}
+		}
+
+		// returns -1 when the frame ran out of queries, the scope is then skipped
+		int begin(const char* name)
+		{
+			auto& frame = ring[current];
+			if (frame.scopes.size() == MAX_SCOPES)
+				return -1;
+
+			const auto index = static_cast<int>(frame.scopes.size());
+			frame.scopes.push_back({ name, depth++ });
+			glQueryCounter(frame.queries[index * 2], GL_TIMESTAMP);
+			gl::checkError();
+			return index;
+		}
+
+		void end(int index)
+		{
+			if (index < 0)
+				return;
+
+			--depth;
+			glQueryCounter(ring[current].queries[index * 2 + 1], GL_TIMESTAMP);
+			gl::checkError();
+		}
+
+		// Closes the current frame and returns results of the oldest one. Results are normally available by then;
+		// if they are not the oldest frame is waited for, because its queries are about to be reused.
+		template<class Function>
+		void endFrame(std::uint64_t frameIndex, Function&& onEvent)
+		{
+			ring[current].frame = frameIndex;
+			ring[current].pending = !ring[current].scopes.empty();
+
+			if (frameIndex - calibratedFrame >= 120)
+			{
+				calibrate();
+				calibratedFrame = frameIndex;
+			}
+
+			current = (current + 1) % FRAMES_IN_FLIGHT;
+			depth = 0;
+
+			auto& oldest = ring[current];
+			if (oldest.pending)
+			{
+				for (auto i = std::size_t{ 0 }; i < oldest.scopes.size(); ++i)
+				{
+					auto begin = GLuint64{ 0 }, end = GLuint64{ 0 };
+					glGetQueryObjectui64v(oldest.queries[i * 2], GL_QUERY_RESULT, &begin);
+					glGetQueryObjectui64v(oldest.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+					const auto& scope = oldest.scopes[i];
+					onEvent(oldest.frame, Event{ scope.name
+						, static_cast<std::int64_t>(begin) + gpuToCpuOffset
+						, static_cast<std::int64_t>(end) + gpuToCpuOffset
+						, scope.depth, GPU_TRACK });
+				}
+				gl::checkError();
+			}
+			oldest.scopes.clear();
+			oldest.pending = false;
+		}
+	};
+
+	struct Frame
+	{
+		std::uint64_t index = 0;
+		std::int64_t begin = 0, end = 0;
+		std::vector<Event> cpu, gpu;
+		bool gpuComplete = false;
+
+		// the whole frame as far as it is covered by scopes: the outermost ones
+		double gpuMs() const
+		{
+			auto ns = std::int64_t{ 0 };
+			for (const auto& event : gpu)
+			{
+				if (event.depth == 0)
+					ns += event.end - event.begin;
+			}
+			return ns / 1e6;
+		}
+
+		// the main thread's work: its outermost scopes, waiting for vsync is in none of them
+		double cpuMs() const
+		{
+			auto ns = std::int64_t{ 0 };
+			for (const auto& event : cpu)
+			{
+				if (event.depth == 0 && event.track == 0)
+					ns += event.end - event.begin;
+			}
+			return ns / 1e6;
+		}
+
+		// summed over the scopes with this name
+		double gpuMs(std::string_view name) const
+		{
+			auto ns = std::int64_t{ 0 };
+			for (const auto& event : gpu)
+			{
+				if (name == event.name)
+					ns += event.end - event.begin;
+			}
+			return ns / 1e6;
+		}
+	};
+
+	class Profiler;
+	Profiler*& instance()
+	{
+		static Profiler* profiler = nullptr;
+		return profiler;
+	}
+
+	class Profiler final
+	{
+		static constexpr std::size_t HISTORY = 8; // has to cover the GPU readback delay
+
+		std::array<Frame, HISTORY> frames;
+		std::uint64_t frameIndex = 0;
+		std::unique_ptr<GpuTimers> gpuTimers;
+
+		using Listener = std::function<void(const Frame&)>;
+		std::vector<std::pair<int, Listener>> listeners;
+		int nextListenerId = 0;
+
+	public:
+		// gpu = false for contexts without timer queries or when only CPU scopes are wanted
+		explicit Profiler(bool gpu = true)
+			: gpuTimers(gpu ? std::make_unique<GpuTimers>() : nullptr)
+		{
+			threadBuffer("main");
+			instance() = this;
+			frames[0].begin = now();
+		}
+
+		Profiler(const Profiler&) = delete;
+		Profiler& operator=(const Profiler&) = delete;
+
+		~Profiler()
+		{
+			instance() = nullptr;
+		}
+
+		GpuTimers* gpu() { return gpuTimers.get(); }
+
+		// called from endFrame() on the main thread for every frame once its GPU timings are in
+		int addListener(Listener listener)
+		{
+			listeners.emplace_back(nextListenerId, std::move(listener));
+			return nextListenerId++;
+		}
+
+		void removeListener(int id)
+		{
+			listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [id](const auto& l) { return l.first == id; }), listeners.end());
+		}
+
+		void endFrame()
+		{
+			auto& frame = frames[frameIndex % HISTORY];
+			frame.index = frameIndex;
+			frame.end = now();
+
+			Registry::get().forEach([&](ThreadBuffer& buffer)
+			{
+				buffer.drain([&](const Event& event) { frame.cpu.push_back(event); });
+			});
+
+			if (gpuTimers)
+			{
+				gpuTimers->endFrame(frameIndex, [&](std::uint64_t index, const Event& event)
+				{
+					auto& gpuFrame = frames[index % HISTORY];
+					if (gpuFrame.index == index)
+						gpuFrame.gpu.push_back(event);
+				});
+
+				if (frameIndex >= GpuTimers::READBACK_DELAY)
+					complete(frames[(frameIndex - GpuTimers::READBACK_DELAY) % HISTORY]);
+			}
+			else
+			{
+				complete(frame);
+			}
+
+			++frameIndex;
+			auto& next = frames[frameIndex % HISTORY];
+			next.index = frameIndex;
+			next.begin = frame.end;
+			next.end = 0;
+			next.cpu.clear();
+			next.gpu.clear();
+			next.gpuComplete = false;
+		}
+
+	private:
+		void complete(Frame& frame)
+		{
+			frame.gpuComplete = true;
+			for (const auto& [id, listener] : listeners)
+				listener(frame);
+		}
+
+	public:
+		// newest frame with both CPU and GPU data, nullptr during the first frames
+		const Frame* lastCompleteFrame() const
+		{
+			const Frame* result = nullptr;
+			for (const auto& frame : frames)
+				if (frame.gpuComplete && frame.end != 0 && (!result || frame.index > result->index))
+					result = &frame;
+			return result;
+		}
+	};
+
+	class CpuScope final
+	{
+		const char* const name;
+		ThreadBuffer* buffer = nullptr;
+		std::int64_t begin = 0;
+
+	public:
+		explicit CpuScope(const char* name) : name(name)
+		{
+			if (!instance())
+				return;
+
+			buffer = &threadBuffer();
+			buffer->depth++;
+			begin = now();
+		}
+
+		CpuScope(const CpuScope&) = delete;
+		CpuScope& operator=(const CpuScope&) = delete;
+
+		~CpuScope()
+		{
+			if (!buffer)
+				return;
+
+			const auto end = now();
+			buffer->depth--;
+			buffer->push({ name, begin, end, buffer->depth, buffer->track });
+		}
+	};
+
+	// has to be used on the thread that owns the GL context
+	class GpuScope final
+	{
+		GpuTimers* timers = nullptr;
+		int index = -1;
+
+	public:
+		explicit GpuScope(const char* name)
+		{
+			if (!instance() || !instance()->gpu())
+				return;
+
+			timers = instance()->gpu();
+			index = timers->begin(name);
+		}
+
+		GpuScope(const GpuScope&) = delete;
+		GpuScope& operator=(const GpuScope&) = delete;
+
+		~GpuScope()
+		{
+			if (timers)
+				timers->end(index);
+		}
+	};
+}
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+#define PROFILE_CPU_SCOPE(name) const auto PROFILER_CONCAT(cpuScope, __LINE__) = profiler::CpuScope(name)
+#define PROFILE_GPU_SCOPE(name) const auto PROFILER_CONCAT(gpuScope, __LINE__) = profiler::GpuScope(name)
+#define PROFILE_SCOPE(name) PROFILE_CPU_SCOPE(name); PROFILE_GPU_SCOPE(name)
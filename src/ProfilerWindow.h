@@ -0,0 +1,155 @@
+#pragma once
+
+#include "Profiler.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace profiler
+{
+	namespace detail
+	{
+		ImU32 colorFor(const char* name)
+		{
+			auto hash = 2166136261u;
+			for (auto c = name; *c; ++c)
+				hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u;
+
+			return IM_COL32(80 + hash % 150, 80 + (hash >> 8) % 150, 80 + (hash >> 16) % 150, 255);
+		}
+
+		// one flame graph row block per track; origin and scale are shared so tracks line up
+		void drawTrack(const char* label, const std::vector<const Event*>& events, std::int64_t origin, double nsPerPixel)
+		{
+			constexpr auto ROW_HEIGHT = 20.f;
+
+			auto maxDepth = std::uint32_t{ 0 };
+			for (const auto* event : events)
+				maxDepth = std::max(maxDepth, event->depth);
+
+			ImGui::TextUnformatted(label);
+
+			auto* drawList = ImGui::GetWindowDrawList();
+			const auto topLeft = ImGui::GetCursorScreenPos();
+			const auto width = ImGui::GetContentRegionAvail().x;
+			const auto height = ROW_HEIGHT * (maxDepth + 1);
+			ImGui::Dummy(ImVec2(width, height));
+
+			drawList->PushClipRect(topLeft, ImVec2(topLeft.x + width, topLeft.y + height), true);
+			for (const auto* event : events)
+			{
+				const auto x1 = topLeft.x + static_cast<float>((event->begin - origin) / nsPerPixel);
+				const auto x2 = std::max(x1 + 1.f, topLeft.x + static_cast<float>((event->end - origin) / nsPerPixel));
+				const auto y1 = topLeft.y + ROW_HEIGHT * event->depth;
+				const auto y2 = y1 + ROW_HEIGHT - 1.f;
+
+				drawList->AddRectFilled(ImVec2(x1, y1), ImVec2(x2, y2), colorFor(event->name));
+				if (x2 - x1 > 40.f)
+					drawList->AddText(ImVec2(x1 + 2.f, y1 + 2.f), IM_COL32(0, 0, 0, 255), event->name);
+
+				if (ImGui::IsMouseHoveringRect(ImVec2(x1, y1), ImVec2(x2, y2)))
+					ImGui::SetTooltip("%s\n%.3f ms", event->name, (event->end - event->begin) / 1e6);
+			}
+			drawList->PopClipRect();
+		}
+	}
+
+	void showWindow(const Profiler& profiler)
+	{
+		static auto paused = false;
+		static auto frozen = Frame{};
+
+		ImGui::Begin("Profiler");
+		ImGui::Checkbox("Pause", &paused);
+
+		const auto* latest = profiler.lastCompleteFrame();
+		if (!paused && latest)
+			frozen = *latest;
+
+		if (frozen.end == 0)
+		{
+			ImGui::Text("Waiting for GPU timings...");
+			ImGui::End();
+			return;
+		}
+
+		const auto& frame = frozen;
+		ImGui::Text("Frame %llu: %.3f ms", static_cast<unsigned long long>(frame.index), (frame.end - frame.begin) / 1e6);
+
+		// scopes pushed while a thread's ring was full are missing from the graph and from traces
+		auto dropped = std::size_t{ 0 };
+		Registry::get().forEach([&dropped](ThreadBuffer& buffer) { dropped += buffer.dropped.load(std::memory_order_relaxed); });
+		if (dropped > 0)
+			ImGui::TextColored(ImVec4(1.f, 0.4f, 0.4f, 1.f), "%zu events dropped, a thread's ring was full", dropped);
+
+		// GPU work trails the CPU, so the GPU track gets its own origin but the same scale
+		auto gpuBegin = std::numeric_limits<std::int64_t>::max(), gpuEnd = std::numeric_limits<std::int64_t>::min();
+		for (const auto& event : frame.gpu)
+		{
+			gpuBegin = std::min(gpuBegin, event.begin);
+			gpuEnd = std::max(gpuEnd, event.end);
+		}
+
+		const auto span = std::max<std::int64_t>(frame.end - frame.begin, frame.gpu.empty() ? 0 : gpuEnd - gpuBegin);
+		const auto nsPerPixel = std::max(1.0, static_cast<double>(span) / std::max(1.f, ImGui::GetContentRegionAvail().x));
+
+		auto tracks = std::map<std::uint32_t, std::vector<const Event*>>{};
+		for (const auto& event : frame.cpu)
+			tracks[event.track].push_back(&event);
+
+		Registry::get().forEach([&](ThreadBuffer& buffer)
+		{
+			if (auto track = tracks.find(buffer.track); track != tracks.end())
+				detail::drawTrack(("CPU: " + buffer.name).c_str(), track->second, frame.begin, nsPerPixel);
+		});
+
+		if (!frame.gpu.empty())
+		{
+			auto gpuEvents = std::vector<const Event*>{};
+			for (const auto& event : frame.gpu)
+				gpuEvents.push_back(&event);
+			detail::drawTrack("GPU", gpuEvents, gpuBegin, nsPerPixel);
+		}
+
+		// totals per scope name
+		struct Totals { double cpu = 0.0, gpu = 0.0; int cpuCount = 0, gpuCount = 0; };
+		auto totals = std::map<std::string, Totals>{};
+		for (const auto& event : frame.cpu)
+		{
+			auto& total = totals[event.name];
+			total.cpu += (event.end - event.begin) / 1e6;
+			total.cpuCount++;
+		}
+		for (const auto& event : frame.gpu)
+		{
+			auto& total = totals[event.name];
+			total.gpu += (event.end - event.begin) / 1e6;
+			total.gpuCount++;
+		}
+
+		if (ImGui::BeginTable("scopes", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+		{
+			ImGui::TableSetupColumn("Scope");
+			ImGui::TableSetupColumn("Count");
+			ImGui::TableSetupColumn("CPU [ms]");
+			ImGui::TableSetupColumn("GPU [ms]");
+			ImGui::TableHeadersRow();
+			for (const auto& [name, total] : totals)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::TextUnformatted(name.c_str());
+				ImGui::TableNextColumn(); ImGui::Text("%d", std::max(total.cpuCount, total.gpuCount));
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", total.cpu);
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", total.gpu);
+			}
+			ImGui::EndTable();
+		}
+
+		ImGui::End();
+	}
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "OpenGLUtils.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace gl
+{
+	// On-disk cache of linked programs (glGetProgramBinary). The key covers the sources of every stage, the defines
+	// and the driver (vendor, renderer, version), so a driver update or an edited shader simply misses.
+	// Binaries the driver rejects are deleted and the program is compiled again.
+	//
+	// file: <directory>/<key as hex>.bin = Header + binary
+	class ProgramCache final
+	{
+		static constexpr auto MAGIC = std::uint32_t{ 0x48434750 }; // "PGCH"
+
+		struct Header
+		{
+			std::uint32_t magic;
+			std::uint32_t format;
+			std::uint32_t length;
+			float compileMs; // what compiling this program took, reported as saved on a hit
+		};
+
+		std::filesystem::path _directory = "shader_cache";
+		bool _enabled = false; // main turns it on, the bench must not leave files behind
+		std::optional<bool> supported;
+		std::vector<GLint> formats; // the driver accepts
+
+		std::size_t _loaded = 0, _compiled = 0, _rejected = 0;
+		float _loadMs = 0.f, _compileMs = 0.f, _savedMs = 0.f;
+
+		static void hashBytes(std::uint64_t& hash, std::string_view bytes)
+		{
+			for (const auto c : bytes)
+				hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+			hash = (hash ^ 0xff) * 1099511628211ull; // separator, "ab" + "c" != "a" + "bc"
+		}
+
+		// glProgramBinary is core in 4.1; the context asks for 3.3 so check what the driver actually gave us
+		bool available()
+		{
+			if (!supported)
+			{
+				auto count = GLint{ 0 };
+				if (GLAD_GL_VERSION_4_1)
+				{
+					glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+					gl::checkError();
+				}
+				formats.resize(std::max(count, 0));
+				if (!formats.empty())
+				{
+					glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+					gl::checkError();
+				}
+				supported = !formats.empty();
+			}
+			return *supported;
+		}
+
+		std::filesystem::path file(std::uint64_t key) const
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+			return _directory / name;
+		}
+
+	public:
+		static ProgramCache& get()
+		{
+			static auto cache = ProgramCache{};
+			return cache;
+		}
+
+		void directory(std::filesystem::path directory) { _directory = std::move(directory); }
+		void enabled(bool enabled) { _enabled = enabled; }
+		bool enabled() { return _enabled && available(); }
+
+		template<class Sources>
+		std::uint64_t key(const Sources& sources, std::string_view defines = {}) const
+		{
+			auto hash = std::uint64_t{ 14695981039346656037ull };
+			for (const auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+				hashBytes(hash, reinterpret_cast<const char*>(glGetString(name)));
+			hashBytes(hash, defines);
+
+			// stage order of an unordered_map is not stable, sort by type
+			auto stages = std::vector<std::pair<unsigned, const std::string*>>{};
+			for (const auto& [type, source] : sources)
+				stages.emplace_back(type, &source);
+			std::sort(stages.begin(), stages.end());
+			for (const auto& [type, source] : stages)
+			{
+				hashBytes(hash, std::to_string(type));
+				hashBytes(hash, *source);
+			}
+			return hash;
+		}
+
+		// linked program or nothing when the binary is missing or rejected
+		std::optional<GLuint> load(std::uint64_t key)
+		{
+			if (!enabled())
+				return std::nullopt;
+
+			const auto start = std::chrono::steady_clock::now();
+			const auto path = file(key);
+			auto in = std::ifstream(path, std::ios::binary);
+			if (!in.is_open())
+				return std::nullopt;
+
+			auto header = Header{};
+			in.read(reinterpret_cast<char*>(&header), sizeof(header));
+			// a truncated or corrupted file must not size the allocation
+			auto error = std::error_code{};
+			const auto size = std::filesystem::file_size(path, error);
+			const auto fits = in && !error && size >= sizeof(header) && header.length <= size - sizeof(header);
+			// glProgramBinary would raise INVALID_ENUM for an unknown format, which the frame's error check reports
+			const auto known = std::find(formats.begin(), formats.end(), static_cast<GLint>(header.format)) != formats.end();
+			auto binary = std::vector<char>(fits && known && header.magic == MAGIC ? header.length : 0);
+			in.read(binary.data(), binary.size());
+			if (!in || binary.empty())
+			{
+				in.close();
+				reject(path);
+				return std::nullopt;
+			}
+
+			const auto program = glCreateProgram();
+			gl::checkError();
+			glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+			gl::checkError();
+
+			// an outdated binary fails to link, compile again
+			auto linked = GLint{ GL_FALSE };
+			glGetProgramiv(program, GL_LINK_STATUS, &linked);
+			gl::checkError();
+			if (linked != GL_TRUE)
+			{
+				glDeleteProgram(program);
+				in.close();
+				reject(path);
+				return std::nullopt;
+			}
+
+			const auto ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			_loaded++;
+			_loadMs += ms;
+			_savedMs += header.compileMs - ms;
+			return program;
+		}
+
+		void store(std::uint64_t key, GLuint program, float compileMs)
+		{
+			_compiled++;
+			_compileMs += compileMs;
+			if (!enabled())
+				return;
+
+			auto length = GLint{ 0 };
+			glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+			gl::checkError();
+			if (length <= 0)
+				return;
+
+			auto header = Header{ MAGIC, 0, static_cast<std::uint32_t>(length), compileMs };
+			auto binary = std::vector<char>(length);
+			auto format = GLenum{ 0 };
+			glGetProgramBinary(program, length, nullptr, &format, binary.data());
+			gl::checkError();
+			header.format = format;
+
+			// a cache that cannot be written is not an error, the next start just compiles again
+			auto error = std::error_code{};
+			std::filesystem::create_directories(_directory, error);
+			auto out = std::ofstream(file(key), std::ios::binary);
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(binary.data(), binary.size());
+		}
+
+		void reject(const std::filesystem::path& path)
+		{
+			_rejected++;
+			auto error = std::error_code{};
+			std::filesystem::remove(path, error);
+		}
+
+		std::size_t loaded() const { return _loaded; }
+		std::size_t compiled() const { return _compiled; }
+		std::size_t rejected() const { return _rejected; }
+		float loadMs() const { return _loadMs; }
+		float compileMs() const { return _compileMs; }
+		float savedMs() const { return _savedMs; }
+	};
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Scene.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Steps the cost of a frame down a ladder of quality levels while frames miss the budget, and back up once they fit
+// with room to spare. Frame cost is the larger of the GPU time and the main thread's CPU time (waiting for vsync is
+// in neither, so a synced 60 fps does not look like a full budget). Hysteresis: stepping down takes DOWN_WINDOW
+// frames over the budget, stepping up UP_WINDOW frames under UP_HEADROOM of it, and the frames still in flight after
+// a change are not measured. This is the slow loop, DynamicResolution takes the first hit on GPU time.
+// Levels are relative to the settings in use when the governor first steps down, stepping back to 0 restores them;
+// settings edited in between are overwritten by the next step. Every step is logged to stdout.
+class QualityGovernor final
+{
+public:
+	struct Level
+	{
+		float spawn; // of the spawn count
+		float blur; // of the gaussian's sigma and the dual filter's levels
+		bool glow; // blur and bloom
+		float lod; // of the size below which particles are drawn as point sprites
+	};
+
+	static constexpr auto LEVELS = std::array<Level, 5>{ {
+		{ 1.f, 1.f, true, 1.f },
+		{ .75f, .75f, true, 2.f },
+		{ .5f, .5f, true, 4.f },
+		{ .25f, .5f, false, 8.f },
+		{ 0.f, .5f, false, 8.f }, // emission stops, what the old 59 fps gate did
+	} };
+
+private:
+	static constexpr int DOWN_WINDOW = 60, UP_WINDOW = 180; // frames
+	static constexpr int IN_FLIGHT = 4; // frames
+	static constexpr double UP_HEADROOM = 0.7;
+
+	struct Settings
+	{
+		float sigma;
+		int dualFilterLevels;
+		bool blur;
+		float pointSpritesBelow;
+	};
+
+	bool _enabled = true;
+	int _level = 0;
+	Settings full{};
+	std::uint64_t lastFrame = ~std::uint64_t{ 0 };
+	double downSum = 0.0, upSum = 0.0;
+	int downSamples = 0, upSamples = 0, skip = 0;
+	std::string _lastDecision;
+
+	void resetWindows()
+	{
+		downSum = upSum = 0.0;
+		downSamples = upSamples = 0;
+	}
+
+	void apply(Scene& scene) const
+	{
+		const auto& level = LEVELS[_level];
+		scene.gaussianBlur().sigma() = full.sigma * level.blur;
+		scene.dualFilterBloom().levels() = std::max(1, static_cast<int>(std::lround(full.dualFilterLevels * level.blur)));
+		scene.blur() = full.blur && level.glow;
+		scene.particleSystem().pointSpritesBelow() = full.pointSpritesBelow * level.lod;
+	}
+
+	void step(int level, Scene& scene, std::uint64_t frame, double meanMs, int frames, double budgetMs)
+	{
+		if (_level == 0)
+			full = Settings{ scene.gaussianBlur().sigma(), scene.dualFilterBloom().levels(), scene.blur(), scene.particleSystem().pointSpritesBelow() };
+
+		auto decision = std::ostringstream{};
+		decision << std::fixed << std::setprecision(2) << "Quality " << _level << " -> " << level << " at frame " << frame << ": " << meanMs << " ms over "
+			<< frames << " frames, budget " << budgetMs << " ms (spawn x" << LEVELS[level].spawn << ", blur x"
+			<< LEVELS[level].blur << ", glow " << (LEVELS[level].glow ? "on" : "off") << ", point sprites x" << LEVELS[level].lod << ")";
+		_lastDecision = decision.str();
+		std::cout << _lastDecision << std::endl;
+
+		_level = level;
+		apply(scene);
+		resetWindows();
+		skip = IN_FLIGHT;
+	}
+
+public:
+	auto& enabled() { return _enabled; }
+	int level() const { return _level; }
+	const std::string& lastDecision() const { return _lastDecision; }
+
+	// what emission uses instead of the requested count
+	int spawnCount(int requested) const
+	{
+		return static_cast<int>(std::lround(requested * LEVELS[_level].spawn));
+	}
+
+	// once per frame before the scene is drawn, with the newest frame the profiler has GPU times for
+	void update(const profiler::Frame* frame, double budgetMs, Scene& scene)
+	{
+		if (!_enabled)
+		{
+			if (_level != 0)
+				step(0, scene, frame ? frame->index : 0, 0.0, 0, budgetMs);
+			return;
+		}
+		if (!frame || frame->index == lastFrame)
+			return;
+		lastFrame = frame->index;
+		if (skip > 0)
+		{
+			skip--;
+			return;
+		}
+
+		const auto ms = std::max(frame->gpuMs(), frame->cpuMs());
+		downSum += ms;
+		upSum += ms;
+		if (++downSamples == DOWN_WINDOW)
+		{
+			const auto mean = downSum / downSamples;
+			if (mean > budgetMs && _level + 1 < static_cast<int>(LEVELS.size()))
+				return step(_level + 1, scene, frame->index, mean, downSamples, budgetMs);
+			downSum = 0.0;
+			downSamples = 0;
+		}
+		if (++upSamples == UP_WINDOW)
+		{
+			const auto mean = upSum / upSamples;
+			if (mean < budgetMs * UP_HEADROOM && _level > 0)
+				return step(_level - 1, scene, frame->index, mean, upSamples, budgetMs);
+			upSum = 0.0;
+			upSamples = 0;
+		}
+	}
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <random>
+
+namespace rng
+{
+	auto& engine()
+	{
+		static std::random_device rd{};
+		static auto engine = std::mt19937{ rd() };
+		return engine;
+	}
+
+	// fixed seed for reproducible runs (benchmarks)
+	void seed(unsigned int value)
+	{
+		engine().seed(value);
+	}
+
+	auto Float()
+	{
+		static auto distribution = std::uniform_real_distribution<float>(-0.002f, 0.002f);
+
+		return distribution(engine());
+	}
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "ParticleProperties.h"
+#include "Camera.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Compact binary log of everything that drives the simulation: rng seed, per-frame sim time and camera,
+// emissions and emitter property changes. Replaying it with the same seed reproduces the particle state bit for bit.
+//
+// layout: header (magic, version, seed, fixed delta), then records, each starting with a one byte tag.
+// Properties and emit records belong to the frame record that follows them.
+namespace recording
+{
+	constexpr auto MAGIC = std::uint32_t{ 0x43455250 }; // "PREC"
+	constexpr auto VERSION = std::uint32_t{ 1 };
+
+	enum class Record : std::uint8_t
+	{
+		Frame = 1,
+		Emit = 2,
+		Properties = 3,
+		End = 4
+	};
+
+	class Recorder final
+	{
+		std::ofstream file;
+		std::optional<ParticleProperties> lastProperties;
+
+		template<class T>
+		void write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+	public:
+		Recorder(const std::filesystem::path& path, std::uint32_t seed, float fixedDelta)
+			: file(path, std::ios::binary)
+		{
+			if (!file.is_open())
+				throw std::runtime_error("Could not open file:" + path.string());
+
+			write(MAGIC);
+			write(VERSION);
+			write(seed);
+			write(fixedDelta);
+		}
+
+		// only written when something changed since the last call
+		void properties(const ParticleProperties& properties)
+		{
+			if (lastProperties && *lastProperties == properties)
+				return;
+			lastProperties = properties;
+
+			write(Record::Properties);
+			write(properties.initialVelocity);
+			write(properties.acceleration);
+			write(properties.startColor);
+			write(properties.endColor);
+			write(properties.totalLifetimeSeconds);
+			write(properties.spawnCount);
+			write(properties.scale);
+			write(properties.particleShape);
+			write(properties.shapeThickness);
+			write(properties.randomVelocity);
+			write(properties.randomAcceleration);
+		}
+
+		void emit(glm::vec3 worldPos, float t)
+		{
+			write(Record::Emit);
+			write(worldPos);
+			write(t);
+		}
+
+		void frame(float time, Camera& camera)
+		{
+			write(Record::Frame);
+			write(time);
+			write(camera.position());
+			write(camera.fov());
+		}
+
+		void finish(std::uint64_t stateHash)
+		{
+			write(Record::End);
+			write(stateHash);
+			file.flush();
+		}
+	};
+
+	class Replay final
+	{
+		std::vector<char> data;
+		std::size_t cursor = 0;
+		std::uint32_t _seed = 0;
+		float _fixedDelta = 0.f;
+		std::optional<std::uint64_t> _expectedHash;
+		std::size_t _frames = 0;
+
+		template<class T>
+		T read()
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			if (cursor + sizeof(T) > data.size())
+				throw std::runtime_error("Recording is truncated");
+
+			auto value = T{};
+			std::memcpy(&value, data.data() + cursor, sizeof(T));
+			cursor += sizeof(T);
+			return value;
+		}
+
+	public:
+		explicit Replay(const std::filesystem::path& path)
+		{
+			auto file = std::ifstream(path, std::ios::binary);
+			if (!file.is_open())
+				throw std::runtime_error("Could not open file:" + path.string());
+			data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+			if (read<std::uint32_t>() != MAGIC)
+				throw std::runtime_error("Not a recording: " + path.string());
+			if (const auto version = read<std::uint32_t>(); version != VERSION)
+				throw std::runtime_error("Unsupported recording version " + std::to_string(version));
+
+			_seed = read<std::uint32_t>();
+			_fixedDelta = read<float>();
+		}
+
+		std::uint32_t seed() const { return _seed; }
+		float fixedDelta() const { return _fixedDelta; }
+		std::size_t frames() const { return _frames; }
+
+		// hash written at the end of the recording, available once the replay reached it
+		std::optional<std::uint64_t> expectedHash() const { return _expectedHash; }
+
+		// Applies property changes and emissions of the next frame and returns its sim time and camera.
+		// Returns false once the recording is over.
+		template<class ParticleSystem>
+		bool nextFrame(ParticleSystem& particleSystem, Camera& camera, float& time)
+		{
+			while (cursor < data.size())
+			{
+				switch (read<Record>())
+				{
+				case Record::Frame:
+					time = read<float>();
+					camera.position() = read<glm::vec3>();
+					camera.fov() = read<float>();
+					_frames++;
+					return true;
+
+				case Record::Emit:
+				{
+					const auto worldPos = read<glm::vec3>();
+					const auto t = read<float>();
+					particleSystem.emit(worldPos, t);
+					break;
+				}
+
+				case Record::Properties:
+				{
+					auto& properties = particleSystem.props();
+					properties.initialVelocity = read<glm::vec3>();
+					properties.acceleration = read<glm::vec3>();
+					properties.startColor = read<glm::vec4>();
+					properties.endColor = read<glm::vec4>();
+					properties.totalLifetimeSeconds = read<int>();
+					properties.spawnCount = read<int>();
+					properties.scale = read<float>();
+					properties.particleShape = read<int>();
+					properties.shapeThickness = read<float>();
+					properties.randomVelocity = read<bool>();
+					properties.randomAcceleration = read<bool>();
+					break;
+				}
+
+				case Record::End:
+					_expectedHash = read<std::uint64_t>();
+					cursor = data.size();
+					break;
+
+				default:
+					throw std::runtime_error("Corrupted recording");
+				}
+			}
+
+			return false;
+		}
+	};
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include "OpenGLUtils.h"
+#include "GLState.h"
+#include "GLDebug.h"
+#include "RenderTargets.h"
+#include "Shader.h"
+#include "ShaderVariants.h"
+#include "TexturedQuad.h"
+#include "Profiler.h"
+
+#include <glad/glad.h>
+
+#include <cassert>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace gl
+{
+	// The passes of one frame with the resources they read and write. execute():
+	// - culls passes whose output nothing on the way to the backbuffer reads
+	// - folds a pointwise pass (full screen, each output texel only depends on the same texel of the inputs) into
+	//   the pointwise pass reading it as its source when that is its only reader; both run as one draw of
+	//   composite.frag and the target in between is never written
+	// - leases targets from the pool right before their writer runs and returns them after their last reader
+	// - sets the viewport to the output's size before every pass, passes drawing at other sizes set their own
+	// Passes are declared again every frame (clear() keeps the storage and the compiled composite variants).
+	class RenderGraph final
+	{
+	public:
+		using Resource = std::size_t;
+		static constexpr Resource BACKBUFFER = 0;
+
+		// stages of composite.frag in the order the shader applies them, one define each
+		enum class Stage : int
+		{
+			Copy = -1, // no stage, the source as it is
+			Bloom = 0, // + factor * bloomTexture
+			Tonemap = 1 // HDR to display range, value = operator
+		};
+		static constexpr int STAGES = 2;
+
+		struct Target
+		{
+			GLuint framebuffer = 0;
+			GLuint texture = 0; // 0 for the backbuffer
+		};
+
+		using Execute = std::function<void(const Target& output, const std::vector<GLuint>& inputs)>;
+
+		struct Pointwise
+		{
+			Stage stage = Stage::Copy;
+			std::vector<UniformName> samplers; // for the inputs after the first (the source)
+			std::function<void(const Shader&)> uniforms;
+			int value = 1; // of the stage's define
+		};
+
+	private:
+		struct ResourceInfo
+		{
+			const char* name;
+			RenderTargetDesc desc; // width 0 = the pool's full size
+		};
+
+		struct Pass
+		{
+			const char* name;
+			std::vector<Resource> inputs; // of a fused pass: the head's inputs, then each stage's samplers
+			Resource output;
+			Execute execute;
+			std::vector<Pointwise> stages; // pointwise passes only, more than one once fused
+			bool culled = false, folded = false;
+		};
+
+		RenderTargetPool& targets;
+		const TexturedQuad& quad;
+		ShaderVariants composite;
+		std::vector<ResourceInfo> resources;
+		std::vector<Pass> passes;
+		std::vector<Resource> kept;
+		std::vector<std::optional<RenderTargetPool::Lease>> leases;
+		std::vector<std::size_t> readers, lastReader;
+		std::vector<int> stageValues;
+		unsigned int backbufferWidth = 0, backbufferHeight = 0; // 0: the pool's size
+		bool _merge = true;
+		std::size_t _executed = 0, _culled = 0, _folded = 0;
+
+		static bool pointwise(const Pass& pass) { return !pass.stages.empty(); }
+
+		// the fused chain has to apply its stages in the shader's order, each at most once
+		static bool ordered(const std::vector<Pointwise>& first, const std::vector<Pointwise>& second)
+		{
+			auto last = static_cast<int>(Stage::Copy);
+			for (const auto* stages : { &first, &second })
+			{
+				for (const auto& pointwise : *stages)
+				{
+					if (pointwise.stage == Stage::Copy)
+						continue;
+					if (static_cast<int>(pointwise.stage) <= last)
+						return false;
+					last = static_cast<int>(pointwise.stage);
+				}
+			}
+			return true;
+		}
+
+		void cull()
+		{
+			auto needed = std::vector<bool>(resources.size(), false);
+			needed[BACKBUFFER] = true;
+			for (const auto resource : kept)
+				needed[resource] = true;
+			for (auto i = passes.size(); i-- > 0;)
+			{
+				auto& pass = passes[i];
+				pass.culled = !needed[pass.output];
+				if (!pass.culled)
+				{
+					for (const auto input : pass.inputs)
+						needed[input] = true;
+				}
+			}
+		}
+
+		void countReaders()
+		{
+			readers.assign(resources.size(), 0);
+			lastReader.assign(resources.size(), 0);
+			for (auto i = std::size_t{ 0 }; i < passes.size(); ++i)
+			{
+				if (passes[i].culled || passes[i].folded)
+					continue;
+				for (const auto input : passes[i].inputs)
+				{
+					readers[input]++;
+					lastReader[input] = i;
+				}
+			}
+		}
+
+		void fold()
+		{
+			for (auto& producer : passes)
+			{
+				if (producer.culled || !pointwise(producer) || producer.output == BACKBUFFER || readers[producer.output] != 1)
+					continue;
+
+				auto& consumer = passes[lastReader[producer.output]];
+				if (!pointwise(consumer) || consumer.inputs.front() != producer.output || !ordered(producer.stages, consumer.stages))
+					continue;
+
+				auto inputs = producer.inputs;
+				inputs.insert(inputs.end(), consumer.inputs.begin() + 1, consumer.inputs.end());
+				auto stages = producer.stages;
+				stages.insert(stages.end(), consumer.stages.begin(), consumer.stages.end());
+				consumer.inputs = std::move(inputs);
+				consumer.stages = std::move(stages);
+				producer.folded = true;
+				countReaders();
+			}
+		}
+
+		void runPointwise(const Pass& pass, const Target& output, const std::vector<GLuint>& inputs)
+		{
+			stageValues.assign(stageValues.size(), 0);
+			for (const auto& pointwise : pass.stages)
+			{
+				if (pointwise.stage != Stage::Copy)
+					stageValues[static_cast<int>(pointwise.stage)] = pointwise.value;
+			}
+			auto& shader = composite.get(stageValues);
+
+			shader.use();
+			gl::bindFramebuffer(GL_FRAMEBUFFER, output.framebuffer);
+			shader.setInt("source", 0);
+			gl::bindTexture(GL_TEXTURE0, inputs[0]);
+			auto unit = 1;
+			for (const auto& pointwise : pass.stages)
+			{
+				for (const auto& sampler : pointwise.samplers)
+				{
+					shader.setInt(sampler, unit);
+					gl::bindTexture(GL_TEXTURE0 + unit, inputs[unit]);
+					unit++;
+				}
+				if (pointwise.uniforms)
+					pointwise.uniforms(shader);
+			}
+
+			gl::bindVertexArray(quad.VAO());
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+			gl::checkError();
+		}
+
+	public:
+		RenderGraph(RenderTargetPool& targets, const TexturedQuad& quad)
+			: targets(targets)
+			, quad(quad)
+			, composite("fullscreen.vert", "composite.frag", { { "BLOOM", 2 }, { "TONEMAP", 3 } })
+			, stageValues(STAGES, 0)
+		{
+			clear();
+		}
+
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+
+		void clear()
+		{
+			resources.clear();
+			passes.clear();
+			kept.clear();
+			resources.push_back(ResourceInfo{ "backbuffer", {} });
+		}
+
+		// when it differs from the pool's full size (dynamic resolution), passes writing it scale what they read
+		void backbufferSize(unsigned int width, unsigned int height)
+		{
+			backbufferWidth = width;
+			backbufferHeight = height;
+		}
+
+		// a full size color target unless desc says otherwise
+		Resource create(const char* name, RenderTargetDesc desc = {})
+		{
+			resources.push_back(ResourceInfo{ name, desc });
+			return resources.size() - 1;
+		}
+
+		// written even though nothing reads it, e.g. to profile a pass the frame does not use
+		void keep(Resource resource)
+		{
+			kept.push_back(resource);
+		}
+
+		// every resource is written by one pass, declared before the passes reading it
+		void addPass(const char* name, std::vector<Resource> inputs, Resource output, Execute execute)
+		{
+			passes.push_back(Pass{ name, std::move(inputs), output, std::move(execute), {} });
+		}
+
+		// for effects outside the graph (a readback): reads inputs, writes nothing and is never culled
+		void addReadback(const char* name, std::vector<Resource> inputs, Execute execute)
+		{
+			addPass(name, std::move(inputs), BACKBUFFER, std::move(execute));
+		}
+
+		void addPointwise(const char* name, std::vector<Resource> inputs, Resource output, Pointwise pointwise)
+		{
+			assert(!inputs.empty() && inputs.size() == pointwise.samplers.size() + 1);
+			passes.push_back(Pass{ name, std::move(inputs), output, {}, { std::move(pointwise) } });
+		}
+
+		void execute()
+		{
+			PROFILE_CPU_SCOPE("render graph");
+
+			cull();
+			countReaders();
+			if (_merge)
+				fold();
+
+			_executed = _culled = _folded = 0;
+			leases.clear();
+			leases.resize(resources.size());
+			auto inputs = std::vector<GLuint>{};
+			for (auto i = std::size_t{ 0 }; i < passes.size(); ++i)
+			{
+				const auto& pass = passes[i];
+				_culled += pass.culled;
+				_folded += pass.folded;
+				if (pass.culled || pass.folded)
+					continue;
+
+				auto output = Target{};
+				auto width = backbufferWidth ? backbufferWidth : targets.width();
+				auto height = backbufferHeight ? backbufferHeight : targets.height();
+				if (pass.output != BACKBUFFER)
+				{
+					const auto& desc = resources[pass.output].desc;
+					leases[pass.output] = desc.width == 0 ? targets.acquire(desc.internalFormat, desc.filter) : targets.acquire(desc);
+					output = Target{ leases[pass.output]->framebuffer(), leases[pass.output]->texture() };
+					width = leases[pass.output]->desc().width;
+					height = leases[pass.output]->desc().height;
+				}
+				glViewport(0, 0, width, height);
+				gl::checkError();
+
+				inputs.clear();
+				for (const auto input : pass.inputs)
+				{
+					assert(leases[input] && "input read before it was written");
+					inputs.push_back(leases[input]->texture());
+				}
+
+				if (pointwise(pass))
+				{
+					PROFILE_SCOPE(pass.name);
+					const auto debugGroup = gl::DebugGroup(pass.name);
+					runPointwise(pass, output, inputs);
+				}
+				else
+					pass.execute(output, inputs);
+				_executed++;
+
+				// back to the pool, a later pass of this frame may alias the target
+				for (const auto input : pass.inputs)
+				{
+					if (lastReader[input] == i)
+						leases[input].reset();
+				}
+			}
+			leases.clear(); // kept outputs, nothing stays leased across frames
+		}
+
+		// fold pointwise passes into their reader, off runs every pass on its own for comparison
+		auto& merge() { return _merge; }
+
+		std::size_t executed() const { return _executed; }
+		std::size_t culled() const { return _culled; }
+		std::size_t folded() const { return _folded; }
+		std::size_t compiledVariants() const { return composite.compiled(); }
+	};
+}
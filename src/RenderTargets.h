@@ -0,0 +1,178 @@
+#pragma once
+
+#include "OpenGLUtils.h"
+#include "GLObjects.h"
+#include "GLDebug.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gl
+{
+	struct RenderTargetDesc
+	{
+		unsigned int width = 0, height = 0;
+		GLenum internalFormat = GL_RGB8;
+		GLenum filter = GL_NEAREST;
+
+		bool operator==(const RenderTargetDesc& other) const
+		{
+			return width == other.width && height == other.height && internalFormat == other.internalFormat && filter == other.filter;
+		}
+	};
+
+	struct RenderTarget
+	{
+		RenderTargetDesc desc;
+		Texture texture;
+		Framebuffer framebuffer;
+		std::uint64_t lastUsed = 0; // frame
+		bool leased = false;
+	};
+
+	// Transient color targets for the passes of a frame. acquire() hands out a free target with the same
+	// description or allocates one; the Lease puts it back when it goes out of scope, so a later pass of the same
+	// frame reuses (aliases) it. Nothing is leased across frames.
+	// resize() only records the size, beginFrame() applies the last one: a window drag resizes once per frame
+	// instead of once per event, and the old targets are freed rather than reallocated in place. Targets nobody
+	// asked for in a while (blur switched off, an old size) are freed there as well.
+	class RenderTargetPool final
+	{
+		static constexpr std::uint64_t EVICT_AFTER_FRAMES = 120;
+
+		std::vector<std::unique_ptr<RenderTarget>> targets; // stable addresses for the leases
+		unsigned int _width, _height;
+		std::optional<std::pair<unsigned int, unsigned int>> pendingSize;
+		std::uint64_t frame = 0;
+		std::size_t _allocations = 0, _resizes = 0;
+
+		void release(RenderTarget& target)
+		{
+			target.leased = false;
+			target.lastUsed = frame;
+		}
+
+	public:
+		class Lease final
+		{
+			RenderTargetPool* pool = nullptr;
+			RenderTarget* target = nullptr;
+
+		public:
+			Lease(RenderTargetPool& pool, RenderTarget& target) : pool(&pool), target(&target) {}
+			~Lease() { reset(); }
+
+			Lease(Lease&& other) noexcept : pool(std::exchange(other.pool, nullptr)), target(std::exchange(other.target, nullptr)) {}
+			Lease& operator=(Lease&& other) noexcept
+			{
+				if (this != &other)
+				{
+					reset();
+					pool = std::exchange(other.pool, nullptr);
+					target = std::exchange(other.target, nullptr);
+				}
+				return *this;
+			}
+
+			Lease(const Lease&) = delete;
+			Lease& operator=(const Lease&) = delete;
+
+			GLuint texture() const { return target->texture; }
+			GLuint framebuffer() const { return target->framebuffer; }
+			const RenderTargetDesc& desc() const { return target->desc; }
+
+			void reset()
+			{
+				if (target)
+					pool->release(*target);
+				pool = nullptr;
+				target = nullptr;
+			}
+		};
+
+		RenderTargetPool(unsigned int width, unsigned int height)
+			: _width(width)
+			, _height(height)
+		{
+		}
+
+		RenderTargetPool(const RenderTargetPool&) = delete;
+		RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+		// full size targets follow this, applied by the next beginFrame()
+		void resize(unsigned int width, unsigned int height)
+		{
+			pendingSize.emplace(width, height);
+		}
+
+		void beginFrame()
+		{
+			frame++;
+
+			// every size derives from the full size, a resize frees them all
+			auto resized = false;
+			if (pendingSize)
+			{
+				resized = pendingSize->first != _width || pendingSize->second != _height;
+				_width = pendingSize->first;
+				_height = pendingSize->second;
+				pendingSize.reset();
+				_resizes += resized;
+			}
+
+			targets.erase(std::remove_if(targets.begin(), targets.end(), [this, resized](const auto& target)
+			{
+				return !target->leased && (resized || frame - target->lastUsed > EVICT_AFTER_FRAMES);
+			}), targets.end());
+		}
+
+		Lease acquire(const RenderTargetDesc& desc)
+		{
+			for (auto& target : targets)
+			{
+				if (!target->leased && target->desc == desc)
+				{
+					target->leased = true;
+					return Lease(*this, *target);
+				}
+			}
+
+			auto& target = *targets.emplace_back(std::make_unique<RenderTarget>());
+			target.desc = desc;
+			target.texture = Texture(genTexture(desc.width, desc.height, desc.internalFormat, desc.filter));
+			target.framebuffer = Framebuffer(genFramebuffer(target.texture));
+			target.leased = true;
+			gl::label(GL_TEXTURE, target.texture, "render target " + std::to_string(targets.size() - 1));
+			_allocations++;
+			return Lease(*this, target);
+		}
+
+		// at the current full size
+		Lease acquire(GLenum internalFormat = GL_RGB8, GLenum filter = GL_NEAREST)
+		{
+			return acquire(RenderTargetDesc{ _width, _height, internalFormat, filter });
+		}
+
+		unsigned int width() const { return _width; }
+		unsigned int height() const { return _height; }
+
+		std::size_t size() const { return targets.size(); }
+		std::size_t allocations() const { return _allocations; }
+		std::size_t resizes() const { return _resizes; }
+
+		std::size_t bytes() const
+		{
+			auto bytes = std::size_t{ 0 };
+			for (const auto& target : targets)
+				bytes += std::size_t{ target->desc.width } * target->desc.height * textureFormat(target->desc.internalFormat).bytesPerPixel;
+			return bytes;
+		}
+	};
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "Shader.h"
+#include "CameraBuffer.h"
+#include "TexturedQuad.h"
+#include "InstancedParticleSystem.h"
+#include "GaussianBlur.h"
+#include "DualFilterBloom.h"
+#include "AdditiveBlend.h"
+#include "Tonemap.h"
+#include "Profiler.h"
+#include "OpenGLUtils.h"
+#include "GLState.h"
+#include "GLDebug.h"
+#include "RenderTargets.h"
+#include "RenderGraph.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// particles -> blur -> bloom -> tonemap -> composite to the default framebuffer; shared by the window and headless
+// replay. Everything before the composite renders at the render scale, the composite upscales (bilinear) to the
+// window's size.
+class Scene final
+{
+public:
+	enum class BlurFilter : int
+	{
+		Gaussian, // 2 full resolution passes, the fetches grow with sigma
+		DualFilter // mip chain, see DualFilterBloom
+	};
+
+	// gets the texture holding the finished frame, display range
+	using Capture = std::function<void(GLuint texture)>;
+
+private:
+	const TexturedQuad quad;
+	gl::RenderTargetPool _targets;
+	gl::RenderGraph _graph;
+	CameraBuffer cameraBuffer;
+	InstancedParticleSystem _particleSystem;
+	GaussianBlur _gaussianBlur;
+	DualFilterBloom _dualFilterBloom;
+	AdditiveBlend _additiveBlend;
+	Tonemap _tonemap;
+	// of everything before the tonemapper; float formats keep what goes above 1 for it
+	GLenum _colorFormat = GL_R11F_G11F_B10F;
+	BlurFilter _blurFilter = BlurFilter::DualFilter;
+	bool _blur = true, _bloom = true;
+	bool _compareFilters = false;
+	bool _verifyBlur = false;
+	float _blurDifference = -1.f;
+	unsigned int _width, _height; // of the window
+	float _renderScale = 1.f;
+
+	unsigned int scaled(unsigned int size) const
+	{
+		return std::max(1u, static_cast<unsigned int>(std::lround(size * _renderScale)));
+	}
+
+public:
+	Scene(unsigned int pool, unsigned int width, unsigned int height)
+		: quad()
+		, _targets(width, height)
+		, _graph(_targets, quad)
+		, cameraBuffer()
+		, _particleSystem(pool)
+		, _gaussianBlur(quad)
+		, _dualFilterBloom(quad)
+		, _additiveBlend()
+		, _tonemap()
+		, _width(width)
+		, _height(height)
+	{
+	}
+
+	auto& particleSystem() { return _particleSystem; }
+	auto& gaussianBlur() { return _gaussianBlur; }
+	auto& dualFilterBloom() { return _dualFilterBloom; }
+	auto& additiveBlend() { return _additiveBlend; }
+	auto& tonemap() { return _tonemap; }
+	auto& colorFormat() { return _colorFormat; }
+	auto& blurFilter() { return _blurFilter; }
+	// runs the filter not in use as well, both then show up in the profiler
+	auto& compareFilters() { return _compareFilters; }
+	// the next frame running the gaussian blur compares its compute and fragment paths
+	void verifyBlur() { _verifyBlur = true; }
+	float blurDifference() const { return _blurDifference; } // see GaussianBlur::verify
+	auto& blur() { return _blur; }
+	auto& bloom() { return _bloom; }
+	const auto& targets() const { return _targets; }
+	auto& graph() { return _graph; }
+
+	// Without capture, bloom, tonemap and the copy run as one pass into the backbuffer. Capture composites into a
+	// target first, that the capture reads and a copy presents.
+	void draw(glm::mat4 view, glm::mat4 projection, float currentTime, const Capture& capture = {})
+	{
+		// ImGui and resize() change state behind the cache between frames
+		gl::invalidateState();
+		_targets.beginFrame();
+		gl::enable(GL_DEPTH_TEST);
+
+		gl::bindFramebuffer(GL_FRAMEBUFFER, 0);
+		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		// every pass is declared, the graph drops the blur and bloom when the composite does not read them
+		using Target = gl::RenderGraph::Target;
+		using Inputs = std::vector<GLuint>;
+		_graph.clear();
+		_graph.backbufferSize(_width, _height);
+		const auto particles = _graph.create("particles", { 0, 0, _colorFormat, GL_LINEAR }); // the blurs fetch between texels
+		const auto gaussian = _graph.create("gaussian blur", { 0, 0, _gaussianBlur.outputFormat(_colorFormat), GL_LINEAR });
+		const auto dualFilter = _graph.create("dual filter bloom", DualFilterBloom::outputDesc(_targets, _colorFormat));
+		const auto blurred = _blurFilter == BlurFilter::Gaussian ? gaussian : dualFilter;
+		// whichever of these the composite reads is upscaled, filtered
+		const auto bloomed = _graph.create("bloomed", { 0, 0, _colorFormat, GL_LINEAR });
+		const auto tonemapped = _graph.create("tonemapped", { 0, 0, GL_RGB8, GL_LINEAR });
+		const auto frame = _graph.create("frame", { _width, _height }); // captures are at the window's size
+
+		_graph.addPass("particles", {}, particles, [&](const Target& output, const Inputs&)
+		{
+			cameraBuffer.update(view, projection, glm::vec2(_targets.width(), _targets.height()));
+			_particleSystem.lodCamera(view, projection, static_cast<float>(_targets.height()));
+			_particleSystem.draw(currentTime, output.framebuffer);
+		});
+		_graph.addPass("gaussian blur", { particles }, gaussian, [this](const Target& output, const Inputs& inputs)
+		{
+			if (std::exchange(_verifyBlur, false))
+				_blurDifference = _gaussianBlur.verify(_targets, inputs[0], _colorFormat);
+			_gaussianBlur.draw(_targets, inputs[0], output, _colorFormat);
+		});
+		_graph.addPass("dual filter bloom", { particles }, dualFilter, [this](const Target& output, const Inputs& inputs)
+		{
+			_dualFilterBloom.draw(_targets, inputs[0], output, _colorFormat);
+		});
+		if (_blur && _compareFilters)
+			_graph.keep(blurred == gaussian ? dualFilter : gaussian);
+		_additiveBlend.addTo(_graph, particles, blurred, bloomed);
+		const auto hdr = _blur ? (_bloom ? bloomed : blurred) : particles;
+		if (_tonemap.op() != Tonemap::Operator::None)
+			_tonemap.addTo(_graph, hdr, tonemapped);
+		const auto display = _tonemap.op() != Tonemap::Operator::None ? tonemapped : hdr;
+		if (capture)
+		{
+			_graph.addPointwise("composite", { display }, frame, {});
+			_graph.addReadback("capture", { frame }, [&](const Target&, const Inputs& inputs) { capture(inputs[0]); });
+			_graph.addPointwise("present", { frame }, gl::RenderGraph::BACKBUFFER, {});
+		}
+		else
+			_graph.addPointwise("composite", { display }, gl::RenderGraph::BACKBUFFER, {});
+
+		_graph.execute();
+	}
+
+	// takes effect at the start of the next frame, however many times it is called until then
+	void resize(unsigned int width, unsigned int height)
+	{
+		if (width == 0 || height == 0)
+			return; // minimized, keep the targets for when the window comes back
+		_width = width;
+		_height = height;
+		_targets.resize(scaled(width), scaled(height));
+	}
+
+	// of the window's size, the targets follow at the start of the next frame
+	void renderScale(float scale)
+	{
+		if (scale == _renderScale)
+			return;
+		_renderScale = scale;
+		_targets.resize(scaled(_width), scaled(_height));
+	}
+	float renderScale() const { return _renderScale; }
+};
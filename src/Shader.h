@@ -1,17 +1,56 @@
 #pragma once
 
+#include "AssetPack.h"
 #include "OpenGLUtils.h"
+#include "GLState.h"
+#include "GLDebug.h"
+#include "ProgramCache.h"
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <string>
-#include <fstream>
+#include <string_view>
 #include <cassert>
 #include <unordered_map>
 #include <filesystem>
+#include <utility>
 #include <vector>
 
+namespace gl
+{
+	// FNV-1a, constexpr so uniform names written as literals are hashed by the compiler
+	constexpr std::uint32_t hash(std::string_view text)
+	{
+		auto hash = std::uint32_t{ 2166136261u };
+		for (const auto c : text)
+			hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+		return hash;
+	}
+
+	// binding points of the uniform blocks shared by several programs, assigned when a program is linked
+	enum UniformBlockBinding : GLuint
+	{
+		CAMERA_BLOCK = 0 // layout (std140) uniform Camera { mat4 view; mat4 projection; vec2 viewport; }, see camera.glsl
+	};
+}
+
+struct UniformName
+{
+	std::uint32_t hash;
+	const char* name;
+
+	template<std::size_t N>
+	constexpr UniformName(const char (&text)[N])
+		: hash(gl::hash(std::string_view(text, N - 1)))
+		, name(text)
+	{
+	}
+};
+
 namespace
 {
 	auto getShaderType(std::string str)
@@ -22,20 +61,92 @@ namespace
 			return GL_VERTEX_SHADER;
 		if (str == "geom" || str == "geometry")
 			return GL_GEOMETRY_SHADER;
+		if (str == "comp" || str == "compute")
+			return GL_COMPUTE_SHADER; // 4.3 contexts only
 
 		assert(false); // unknown type
 	}
 
-	std::string readFile(std::filesystem::path path)
+	// Expands #include "file" (next to the including file, each file once per stage). The #line directives keep
+	// compile errors pointing at the right line, the source string number is the index in `included`.
+	void expandIncludes(const std::filesystem::path& path, std::string_view source, std::string& out, std::vector<std::filesystem::path>& included)
 	{
-		auto file = std::ifstream(path.c_str());
-		assert(file.is_open());
-		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		const auto INCLUDE = std::string_view("#include");
+		const auto index = std::to_string(included.size() - 1);
+
+		auto lineNumber = 0;
+		for (auto begin = std::size_t{ 0 }; begin < source.size();)
+		{
+			auto end = source.find('\n', begin);
+			end = end == std::string_view::npos ? source.size() : end;
+			const auto line = source.substr(begin, end - begin);
+			begin = end + 1;
+			lineNumber++;
+
+			const auto directive = line.find_first_not_of(" \t");
+			if (directive == std::string_view::npos || line.substr(directive, INCLUDE.size()) != INCLUDE)
+			{
+				out.append(line).append("\n");
+				continue;
+			}
+
+			const auto open = line.find('"', directive);
+			const auto close = open == std::string_view::npos ? open : line.find('"', open + 1);
+			if (close == std::string_view::npos)
+				throw std::runtime_error(path.string() + ":" + std::to_string(lineNumber) + ": expected #include \"file\"");
+
+			const auto file = path.parent_path() / std::string(line.substr(open + 1, close - open - 1));
+			if (std::find(included.begin(), included.end(), file) != included.end())
+				continue;
+
+			included.push_back(file);
+			out.append("#line 1 " + std::to_string(included.size() - 1) + "\n");
+			auto storage = std::string{};
+			expandIncludes(file, assets::read(file, storage), out, included);
+			out.append("#line " + std::to_string(lineNumber + 1) + " " + index + "\n");
+		}
+	}
+
+	// #define NAME VALUE for every define, right after #version which has to stay the first statement
+	std::string injectDefines(std::string source, const std::vector<std::string>& defines)
+	{
+		if (defines.empty())
+			return source;
+
+		auto block = std::string{};
+		for (const auto& define : defines)
+			block += "#define " + define + "\n";
+
+		const auto version = source.find("#version");
+		const auto versionEnd = version == std::string::npos ? version : source.find('\n', version);
+		if (versionEnd == std::string::npos)
+			return block + source;
+
+		const auto versionLine = std::count(source.begin(), source.begin() + versionEnd, '\n') + 1;
+		block += "#line " + std::to_string(versionLine + 1) + "\n";
+		source.insert(versionEnd + 1, block);
+		return source;
+	}
+
+	// one stage of `path` as the compiler gets it, every file read on the way is added to `files`
+	std::string preprocess(const std::filesystem::path& path, std::string_view source, const std::vector<std::string>& defines, std::vector<std::filesystem::path>& files)
+	{
+		auto included = std::vector<std::filesystem::path>{ path };
+		auto out = std::string{};
+		out.reserve(source.size());
+		expandIncludes(path, source, out, included);
+
+		for (const auto& file : included)
+		{
+			if (std::find(files.begin(), files.end(), file) == files.end())
+				files.push_back(file);
+		}
+		return injectDefines(std::move(out), defines);
 	}
 
 	auto compileShader(int type, std::string_view src)
 	{
-		assert(type == GL_VERTEX_SHADER || type == GL_FRAGMENT_SHADER || type == GL_GEOMETRY_SHADER);
+		assert(type == GL_VERTEX_SHADER || type == GL_FRAGMENT_SHADER || type == GL_GEOMETRY_SHADER || type == GL_COMPUTE_SHADER);
 		assert(src.length());
 
 		const auto id = glCreateShader(type);
@@ -59,49 +170,27 @@ namespace
 		return id;
 	}
 
-	auto preprocessPath(std::filesystem::path path)
-	{
-		if (!path.has_parent_path())
-		{
-			// move from {root}/build/Release to {root}/assets on Windows
-			// TODO build list for possible paths
-			if (std::filesystem::exists("../../assets"))
-			{
-				return std::filesystem::path("../../assets") / path;
-			}
-			else if (std::filesystem::exists("../assets"))
-			{
-				return std::filesystem::path("../assets") / path;
-			}
-			else
-			{
-				throw std::runtime_error("Could not open file:" + path.string());
-			}
-		}
-
-		return path;
-	}
-
-	auto loadShaderSources(std::filesystem::path combinedShader)
+	auto loadShaderSources(std::filesystem::path combinedShader, const std::vector<std::string>& defines, std::vector<std::filesystem::path>& files)
 	{
-		combinedShader = preprocessPath(combinedShader);
+		combinedShader = assets::resolve(combinedShader);
 
-		const auto TYPE_STR = std::string("#type "); // constexpr :(
+		const auto TYPE_STR = std::string_view("#type ");
 		auto shadersSources = std::unordered_map<unsigned, std::string>{};
 
-		auto file = std::ifstream(combinedShader.c_str());
-
-		if (!file.is_open())
-		{
-			throw std::runtime_error("Could not open file:" + combinedShader.string());
-		}
+		auto storage = std::string{};
+		const auto file = assets::read(combinedShader, storage);
 
 		unsigned currentShaderType = 0;
-		for (auto line = std::string{}; std::getline(file, line);)
+		for (auto begin = std::size_t{ 0 }; begin < file.size();)
 		{
-			if (line.find(TYPE_STR) == 0)
+			auto end = file.find('\n', begin);
+			end = end == std::string_view::npos ? file.size() : end;
+			const auto line = file.substr(begin, end - begin);
+			begin = end + 1;
+
+			if (line.substr(0, TYPE_STR.length()) == TYPE_STR)
 			{
-				currentShaderType = getShaderType(line.substr(TYPE_STR.length()));
+				currentShaderType = getShaderType(std::string(line.substr(TYPE_STR.length())));
 			}
 			else if (currentShaderType == 0)
 			{
@@ -109,21 +198,25 @@ namespace
 			}
 			else
 			{
-				shadersSources[currentShaderType].append(line + "\n");
+				shadersSources[currentShaderType].append(line).append("\n");
 			}
 		}
 
+		for (auto& [type, source] : shadersSources)
+			source = preprocess(combinedShader, source, defines, files);
+
 		return shadersSources;
 	}
 
-	auto loadShaderSources(std::filesystem::path vertex, std::filesystem::path fragment)
+	auto loadShaderSources(std::filesystem::path vertex, std::filesystem::path fragment, const std::vector<std::string>& defines, std::vector<std::filesystem::path>& files)
 	{
-		vertex = preprocessPath(vertex);
-		fragment = preprocessPath(fragment);
+		vertex = assets::resolve(vertex);
+		fragment = assets::resolve(fragment);
 
+		auto storage = std::string{};
 		auto shadersSources = std::unordered_map<unsigned, std::string>{};
-		shadersSources[GL_VERTEX_SHADER] = readFile(vertex);
-		shadersSources[GL_FRAGMENT_SHADER] = readFile(fragment);
+		shadersSources[GL_VERTEX_SHADER] = preprocess(vertex, assets::read(vertex, storage), defines, files);
+		shadersSources[GL_FRAGMENT_SHADER] = preprocess(fragment, assets::read(fragment, storage), defines, files);
 
 		assert(shadersSources[GL_VERTEX_SHADER].length());
 		assert(shadersSources[GL_FRAGMENT_SHADER].length());
@@ -133,6 +226,13 @@ namespace
 
 	auto createProgram(std::unordered_map<unsigned, std::string> shadersSources)
 	{
+		auto& cache = gl::ProgramCache::get();
+		const auto key = cache.key(shadersSources);
+		if (const auto program = cache.load(key))
+			return *program;
+
+		const auto start = std::chrono::steady_clock::now();
+
 		auto shaders = std::vector<unsigned>();
 		shaders.reserve(shadersSources.size());
 
@@ -151,6 +251,12 @@ namespace
 			gl::checkError();
 		}
 
+		if (cache.enabled())
+		{
+			glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			gl::checkError();
+		}
+
 		glLinkProgram(id);
 		gl::checkError();
 
@@ -171,124 +277,308 @@ namespace
 			gl::checkError();
 		}
 
+		cache.store(key, id, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+
 		return id;
 	}
 }
 
 class Shader final
 {
-	const unsigned _id;
+	const std::vector<std::filesystem::path> paths; // resolved, a combined file or vertex + fragment
+	const std::vector<std::string> defines; // "NAME VALUE"
+	std::vector<std::filesystem::path> _files; // paths and everything they include
+	unsigned _id;
+	// unlike the address, never reused by a later shader
+	const std::uint64_t _serial = [] { static auto serial = std::uint64_t{ 0 }; return ++serial; }();
+
+	// (name hash, location) of every active uniform outside a block, sorted by hash
+	std::vector<std::pair<std::uint32_t, GLint>> locations;
+
+	void cacheUniforms()
+	{
+		auto count = GLint{ 0 };
+		glGetProgramiv(_id, GL_ACTIVE_UNIFORMS, &count);
+		gl::checkError();
+
+		const auto add = [this](const std::string& name)
+		{
+			const auto location = glGetUniformLocation(_id, name.c_str());
+			gl::checkError();
+			gl::counters().getUniformLocation++;
+			locations.emplace_back(gl::hash(name), location);
+		};
 
+		for (auto i = GLuint{ 0 }; i < static_cast<GLuint>(count); ++i)
+		{
+			GLchar buffer[256];
+			auto length = GLsizei{ 0 };
+			auto size = GLint{ 0 };
+			auto type = GLenum{ 0 };
+			glGetActiveUniform(_id, i, sizeof(buffer), &length, &size, &type, buffer);
+			gl::checkError();
+
+			auto block = GLint{ -1 };
+			glGetActiveUniformsiv(_id, 1, &i, GL_UNIFORM_BLOCK_INDEX, &block);
+			gl::checkError();
+			if (block != -1)
+				continue; // lives in a uniform buffer
+
+			// arrays are reported as "name[0]", make "name" and every "name[i]" resolvable
+			auto name = std::string(buffer, length);
+			if (const auto bracket = name.find('['); bracket != std::string::npos)
+			{
+				name.resize(bracket);
+				add(name);
+				for (auto element = 0; element < size; ++element)
+					add(name + "[" + std::to_string(element) + "]");
+			}
+			else
+				add(name);
+		}
+
+		std::sort(locations.begin(), locations.end());
+		for (auto i = std::size_t{ 1 }; i < locations.size(); ++i)
+		{
+			if (locations[i - 1].first == locations[i].first)
+				throw std::runtime_error("Uniform name hash collision in program " + std::to_string(_id));
+		}
+	}
+
+	void bindUniformBlocks() const
+	{
+		const auto camera = glGetUniformBlockIndex(_id, "Camera");
+		gl::checkError();
+		if (camera != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding(_id, camera, gl::CAMERA_BLOCK);
+			gl::checkError();
+		}
+	}
+
+	// carries uniform values (samplers set once at construction, mostly) from one program over to its replacement
+	static void copyUniforms(GLuint from, GLuint to)
+	{
+		auto current = GLint{ 0 };
+		glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+		glUseProgram(to);
+		gl::checkError();
+
+		auto count = GLint{ 0 };
+		glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &count);
+		for (auto i = GLuint{ 0 }; i < static_cast<GLuint>(count); ++i)
+		{
+			GLchar buffer[256];
+			auto length = GLsizei{ 0 };
+			auto size = GLint{ 0 };
+			auto type = GLenum{ 0 };
+			glGetActiveUniform(to, i, sizeof(buffer), &length, &size, &type, buffer);
+
+			auto name = std::string(buffer, length);
+			if (const auto bracket = name.find('['); bracket != std::string::npos)
+				name.resize(bracket);
+
+			for (auto element = 0; element < size; ++element)
+			{
+				const auto elementName = size > 1 ? name + "[" + std::to_string(element) + "]" : name;
+				const auto source = glGetUniformLocation(from, elementName.c_str());
+				const auto target = glGetUniformLocation(to, elementName.c_str());
+				if (source == -1 || target == -1)
+					continue; // new uniform, or one in a block
+
+				GLfloat floats[16];
+				GLint ints[4];
+				switch (type)
+				{
+				case GL_FLOAT: glGetUniformfv(from, source, floats); glUniform1fv(target, 1, floats); break;
+				case GL_FLOAT_VEC2: glGetUniformfv(from, source, floats); glUniform2fv(target, 1, floats); break;
+				case GL_FLOAT_VEC3: glGetUniformfv(from, source, floats); glUniform3fv(target, 1, floats); break;
+				case GL_FLOAT_VEC4: glGetUniformfv(from, source, floats); glUniform4fv(target, 1, floats); break;
+				case GL_FLOAT_MAT3: glGetUniformfv(from, source, floats); glUniformMatrix3fv(target, 1, GL_FALSE, floats); break;
+				case GL_FLOAT_MAT4: glGetUniformfv(from, source, floats); glUniformMatrix4fv(target, 1, GL_FALSE, floats); break;
+				case GL_INT:
+				case GL_BOOL:
+				case GL_SAMPLER_2D: glGetUniformiv(from, source, ints); glUniform1iv(target, 1, ints); break;
+				default: break;
+				}
+				gl::checkError();
+			}
+		}
+
+		glUseProgram(current);
+		gl::checkError();
+	}
+
+	// -1 for names that are not active (optimised out), which glUniform* ignores like glGetUniformLocation would
+	GLint location(UniformName name) const
+	{
+		const auto it = std::lower_bound(locations.begin(), locations.end(), name.hash, [](const auto& entry, std::uint32_t hash) { return entry.first < hash; });
+		gl::counters().uniform++;
+		return it != locations.end() && it->first == name.hash ? it->second : -1;
+	}
 
 public:
-	Shader(std::filesystem::path combinedShaderPath)
-		: _id(createProgram(loadShaderSources(combinedShaderPath)))
+	// every live shader, the hot reloader looks up the ones using a changed file here
+	static std::vector<Shader*>& registry()
 	{
+		static auto shaders = std::vector<Shader*>{};
+		return shaders;
+	}
 
+	// bumped when a shader is created or its files() are refreshed, the hot reloader only watches new files then
+	static std::uint64_t& generation()
+	{
+		static auto generation = std::uint64_t{ 0 };
+		return generation;
 	}
 
-	Shader(std::filesystem::path vertex, std::filesystem::path fragment)
-		: _id(createProgram(loadShaderSources(vertex, fragment)))
+	Shader(std::filesystem::path combinedShaderPath, std::vector<std::string> defines = {})
+		: paths{ assets::resolve(combinedShaderPath) }
+		, defines(std::move(defines))
+		, _id(createProgram(sources()))
 	{
+		cacheUniforms();
+		bindUniformBlocks();
+		gl::label(GL_PROGRAM, _id, name());
+		registry().push_back(this);
+	}
 
+	Shader(std::filesystem::path vertex, std::filesystem::path fragment, std::vector<std::string> defines = {})
+		: paths{ assets::resolve(vertex), assets::resolve(fragment) }
+		, defines(std::move(defines))
+		, _id(createProgram(sources()))
+	{
+		cacheUniforms();
+		bindUniformBlocks();
+		gl::label(GL_PROGRAM, _id, name());
+		registry().push_back(this);
 	}
 
 	~Shader()
 	{
+		auto& shaders = registry();
+		shaders.erase(std::remove(shaders.begin(), shaders.end(), this), shaders.end());
+
 		glDeleteProgram(_id);
 		gl::checkError();
+		gl::invalidateState();
 	}
 
-	void use() const
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
+	const auto& files() const { return _files; }
+	std::uint64_t serial() const { return _serial; }
+
+	// current contents of the files by stage, preprocessed; also refreshes files() as includes may have changed
+	std::unordered_map<unsigned, std::string> sources()
 	{
-		glUseProgram(_id);
-		gl::checkError();
+		auto files = std::vector<std::filesystem::path>{};
+		auto sources = paths.size() == 1 ? loadShaderSources(paths[0], defines, files) : loadShaderSources(paths[0], paths[1], defines, files);
+		_files = std::move(files);
+		generation()++;
+		return sources;
 	}
 
-	void setInt(const std::string& name, int value) const
+	std::string name() const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
-		gl::checkError();
-		glUniform1i(location, value);
-		gl::checkError();
+		auto name = paths[0].filename().string();
+		for (auto i = std::size_t{ 1 }; i < paths.size(); ++i)
+			name += " + " + paths[i].filename().string();
+		for (auto i = std::size_t{ 0 }; i < defines.size(); ++i)
+			name += (i == 0 ? " [" : ", ") + defines[i] + (i + 1 == defines.size() ? "]" : "");
+		return name;
 	}
 
-	void setFloat(const std::string& name, float value) const
+	// takes over a linked program built from sources() (hot reload), between frames
+	void replace(unsigned program)
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
-		gl::checkError();
-		glUniform1f(location, value);
+		copyUniforms(_id, program);
+		glDeleteProgram(_id);
 		gl::checkError();
+		gl::invalidateState();
+
+		_id = program;
+		locations.clear();
+		cacheUniforms();
+		bindUniformBlocks();
+		gl::label(GL_PROGRAM, _id, name());
 	}
 
-	void setVec2(const std::string& name, const glm::vec2& value) const
+	void use() const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
-		gl::checkError();
-		glUniform2fv(location , 1, &value[0]);
-		gl::checkError();
+		gl::useProgram(_id);
 	}
 
-	void setVec2(const std::string& name, float x, float y) const
+	void setInt(UniformName name, int value) const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
-		gl::checkError();
-		glUniform2f(location, x, y);
+		glUniform1i(location(name), value);
 		gl::checkError();
 	}
 
-	void setVec3(const std::string& name, const glm::vec3& value) const
+	void setFloat(UniformName name, float value) const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
-		gl::checkError();
-		glUniform3fv(location, 1, &value[0]);
+		glUniform1f(location(name), value);
 		gl::checkError();
 	}
 
-	void setVec3(const std::string& name, float x, float y, float z) const
+	// float name[count], from element 0
+	void setFloatArray(UniformName name, const float* values, GLsizei count) const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
-		gl::checkError();
-		glUniform3f(location, x, y, z);
+		glUniform1fv(location(name), count, values);
 		gl::checkError();
 	}
 
-	void setVec4(const std::string& name, const glm::vec4& value) const
+	void setVec2(UniformName name, const glm::vec2& value) const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
+		glUniform2fv(location(name), 1, &value[0]);
 		gl::checkError();
-		glUniform4fv(location, 1, &value[0]);
+	}
+
+	void setVec2(UniformName name, float x, float y) const
+	{
+		glUniform2f(location(name), x, y);
 		gl::checkError();
 	}
-	void setVec4(const std::string& name, float x, float y, float z, float w) const
+
+	void setVec3(UniformName name, const glm::vec3& value) const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
+		glUniform3fv(location(name), 1, &value[0]);
 		gl::checkError();
-		glUniform4f(location, x, y, z, w);
+	}
+
+	void setVec3(UniformName name, float x, float y, float z) const
+	{
+		glUniform3f(location(name), x, y, z);
 		gl::checkError();
 	}
 
-	void setMat2(const std::string& name, const glm::mat2& mat) const
+	void setVec4(UniformName name, const glm::vec4& value) const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
+		glUniform4fv(location(name), 1, &value[0]);
 		gl::checkError();
-		glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+	}
+	void setVec4(UniformName name, float x, float y, float z, float w) const
+	{
+		glUniform4f(location(name), x, y, z, w);
 		gl::checkError();
 	}
 
-	void setMat3(const std::string& name, const glm::mat3& mat) const
+	void setMat2(UniformName name, const glm::mat2& mat) const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
-		gl::checkError();
-		glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
 		gl::checkError();
 	}
 
-	void setMat4(const std::string& name, const glm::mat4& mat) const
+	void setMat3(UniformName name, const glm::mat3& mat) const
 	{
-		const auto location = glGetUniformLocation(_id, name.c_str());
+		glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
 		gl::checkError();
-		glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+	}
+
+	void setMat4(UniformName name, const glm::mat4& mat) const
+	{
+		glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
 		gl::checkError();
 	}
 };
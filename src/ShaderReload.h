@@ -0,0 +1,388 @@
+#pragma once
+
+#include "Shader.h"
+#include "ProgramCache.h"
+#include "Profiler.h"
+#include "OpenGLUtils.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace gl
+{
+	// KHR_parallel_shader_compile (and the ARB variant) is not part of the generated glad
+	constexpr GLenum COMPLETION_STATUS_KHR = 0x91B1;
+
+	// Reports watched files written since the last poll. inotify on Linux, comparing modification times a few
+	// times per second everywhere else or when inotify is not available.
+	class FileWatcher final
+	{
+		std::map<std::filesystem::path, std::filesystem::file_time_type> files;
+		std::set<std::filesystem::path> missing; // not on disk (embedded assets), not looked up again
+		std::chrono::steady_clock::time_point lastScan;
+
+#ifdef __linux__
+		int fd = -1;
+		std::map<int, std::filesystem::path> directories; // watch descriptor -> directory
+
+		void fallBackToPolling()
+		{
+			::close(fd);
+			fd = -1;
+			directories.clear();
+		}
+#endif
+
+		std::set<std::filesystem::path> scan()
+		{
+			auto changed = std::set<std::filesystem::path>{};
+			const auto now = std::chrono::steady_clock::now();
+			if (now - lastScan < std::chrono::milliseconds(250))
+				return changed;
+			lastScan = now;
+
+			for (auto& [file, time] : files)
+			{
+				auto error = std::error_code{};
+				const auto current = std::filesystem::last_write_time(file, error);
+				if (!error && current != time)
+				{
+					time = current;
+					changed.insert(file);
+				}
+			}
+			return changed;
+		}
+
+	public:
+		FileWatcher()
+		{
+#ifdef __linux__
+			fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+		}
+
+		~FileWatcher()
+		{
+#ifdef __linux__
+			if (fd >= 0)
+				::close(fd);
+#endif
+		}
+
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		void watch(const std::filesystem::path& file)
+		{
+			// embedded assets have nothing on disk to watch, use --assets for hot reload
+			if (files.count(file) || missing.count(file))
+				return;
+			auto error = std::error_code{};
+			if (!std::filesystem::is_regular_file(file, error))
+			{
+				missing.insert(file);
+				return;
+			}
+
+			files[file] = std::filesystem::last_write_time(file, error);
+
+#ifdef __linux__
+			const auto directory = file.parent_path();
+			const auto watched = std::any_of(directories.begin(), directories.end(), [&directory](const auto& entry) { return entry.second == directory; });
+			if (fd >= 0 && !watched)
+			{
+				// the directory rather than the file: editors often write a temporary file and rename it over the original
+				const auto wd = ::inotify_add_watch(fd, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+				if (wd >= 0)
+					directories[wd] = directory;
+				else
+					fallBackToPolling();
+			}
+#endif
+		}
+
+		std::set<std::filesystem::path> poll()
+		{
+#ifdef __linux__
+			if (fd >= 0)
+			{
+				auto changed = std::set<std::filesystem::path>{};
+				alignas(inotify_event) char buffer[4096];
+				for (auto length = ::read(fd, buffer, sizeof(buffer)); length > 0; length = ::read(fd, buffer, sizeof(buffer)))
+				{
+					for (auto* next = buffer; next < buffer + length;)
+					{
+						const auto* event = reinterpret_cast<const inotify_event*>(next);
+						next += sizeof(inotify_event) + event->len;
+
+						const auto directory = directories.find(event->wd);
+						if (event->len == 0 || directory == directories.end())
+							continue;
+						const auto file = directory->second / event->name;
+						if (files.count(file))
+							changed.insert(file);
+					}
+				}
+				return changed;
+			}
+#endif
+			return scan();
+		}
+
+		bool native() const
+		{
+#ifdef __linux__
+			return fd >= 0;
+#else
+			return false;
+#endif
+		}
+	};
+
+	// Recompiles shaders whose files changed and swaps the new programs in between frames. With
+	// KHR_parallel_shader_compile the driver compiles in the background and update() only picks up finished
+	// programs; without it the compile happens inside update(). A shader that fails to compile keeps its last good
+	// program, the log is kept in errors() for the overlay until the shader compiles again.
+	class ShaderReloader final
+	{
+		struct Job
+		{
+			Shader* shader;
+			std::uint64_t serial; // of the shader, its address may be taken by a newer one before the job finishes
+			GLuint program;
+			std::vector<GLuint> stages;
+			std::uint64_t key;
+			std::chrono::steady_clock::time_point start;
+		};
+
+		struct Error
+		{
+			std::string shader;
+			std::string log;
+			std::uint64_t serial;
+		};
+
+		FileWatcher watcher;
+		std::vector<Job> jobs;
+		std::map<const Shader*, Error> _errors;
+		bool parallel = false;
+		std::size_t _reloaded = 0;
+		std::uint64_t watchedGeneration = ~std::uint64_t{ 0 }; // of Shader::generation()
+
+		static bool registered(const Shader* shader, std::uint64_t serial)
+		{
+			const auto& shaders = Shader::registry();
+			return std::find(shaders.begin(), shaders.end(), shader) != shaders.end() && shader->serial() == serial;
+		}
+
+		static std::string shaderLog(GLuint shader)
+		{
+			GLchar log[1024];
+			auto length = GLsizei{ 0 };
+			glGetShaderInfoLog(shader, sizeof(log), &length, log);
+			return std::string(log, length);
+		}
+
+		static std::string programLog(GLuint program)
+		{
+			GLchar log[1024];
+			auto length = GLsizei{ 0 };
+			glGetProgramInfoLog(program, sizeof(log), &length, log);
+			return std::string(log, length);
+		}
+
+		void discard(Job& job)
+		{
+			for (const auto stage : job.stages)
+				glDeleteShader(stage);
+			glDeleteProgram(job.program);
+			gl::checkError();
+		}
+
+		void swap(Shader& shader, GLuint program, float ms)
+		{
+			shader.replace(program);
+			_errors.erase(&shader);
+			_reloaded++;
+			std::cout << "Reloaded " << shader.name() << " in " << ms << " ms" << std::endl;
+		}
+
+		void start(Shader& shader)
+		{
+			for (auto it = jobs.begin(); it != jobs.end();)
+			{
+				if (it->shader != &shader)
+				{
+					++it;
+					continue;
+				}
+				discard(*it); // superseded by the newer edit
+				it = jobs.erase(it);
+			}
+
+			auto sources = std::unordered_map<unsigned, std::string>{};
+			try
+			{
+				sources = shader.sources();
+			}
+			catch (const std::exception& e)
+			{
+				_errors[&shader] = Error{ shader.name(), e.what(), shader.serial() };
+				return;
+			}
+
+			// an edit that was undone is usually still in the program cache
+			auto& cache = ProgramCache::get();
+			const auto startTime = std::chrono::steady_clock::now();
+			const auto key = cache.key(sources);
+			if (const auto program = cache.load(key))
+			{
+				swap(shader, *program, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+				return;
+			}
+
+			auto job = Job{ &shader, shader.serial(), glCreateProgram(), {}, key, startTime };
+			for (const auto& [type, source] : sources)
+			{
+				const auto stage = glCreateShader(type);
+				const char* text = source.c_str();
+				glShaderSource(stage, 1, &text, nullptr);
+				glCompileShader(stage);
+				glAttachShader(job.program, stage);
+				job.stages.push_back(stage);
+			}
+			if (cache.enabled())
+				glProgramParameteri(job.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+			// linking right away is fine with parallel compile, the driver chains it after the stages
+			glLinkProgram(job.program);
+			gl::checkError();
+			jobs.push_back(std::move(job));
+		}
+
+		void finish(Job& job)
+		{
+			auto log = std::string{};
+			for (const auto stage : job.stages)
+			{
+				auto compiled = GLint{ GL_FALSE };
+				glGetShaderiv(stage, GL_COMPILE_STATUS, &compiled);
+				if (!compiled)
+					log += shaderLog(stage);
+			}
+
+			auto linked = GLint{ GL_FALSE };
+			glGetProgramiv(job.program, GL_LINK_STATUS, &linked);
+			gl::checkError();
+			if (!linked && log.empty())
+				log = programLog(job.program);
+
+			const auto live = registered(job.shader, job.serial);
+			if (!linked || !live)
+			{
+				if (live)
+					_errors[job.shader] = Error{ job.shader->name(), log, job.serial };
+				discard(job);
+				return;
+			}
+
+			for (const auto stage : job.stages)
+				glDeleteShader(stage);
+
+			const auto ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - job.start).count();
+			ProgramCache::get().store(job.key, job.program, ms);
+			swap(*job.shader, job.program, ms);
+		}
+
+	public:
+		ShaderReloader()
+		{
+			auto count = GLint{ 0 };
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+			gl::checkError();
+			for (auto i = GLuint{ 0 }; i < static_cast<GLuint>(count); ++i)
+			{
+				const auto extension = std::string_view(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)));
+				parallel |= extension == "GL_KHR_parallel_shader_compile" || extension == "GL_ARB_parallel_shader_compile";
+			}
+		}
+
+		~ShaderReloader()
+		{
+			for (auto& job : jobs)
+				discard(job);
+		}
+
+		ShaderReloader(const ShaderReloader&) = delete;
+		ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+		// call between frames, nothing is swapped while a frame is being drawn
+		void update()
+		{
+			PROFILE_CPU_SCOPE("shader reload");
+
+			// only when shaders were added or their includes changed, not every frame
+			const auto& shaders = Shader::registry();
+			if (watchedGeneration != Shader::generation())
+			{
+				watchedGeneration = Shader::generation();
+				for (const auto* shader : shaders)
+				{
+					for (const auto& file : shader->files())
+						watcher.watch(file);
+				}
+			}
+
+			const auto changed = watcher.poll();
+			if (!changed.empty())
+			{
+				for (auto* shader : shaders)
+				{
+					const auto& files = shader->files();
+					if (std::any_of(files.begin(), files.end(), [&changed](const auto& file) { return changed.count(file) != 0; }))
+						start(*shader);
+				}
+			}
+
+			for (auto it = jobs.begin(); it != jobs.end();)
+			{
+				auto done = GLint{ GL_TRUE };
+				if (parallel)
+					glGetProgramiv(it->program, COMPLETION_STATUS_KHR, &done);
+				if (!done)
+				{
+					++it;
+					continue;
+				}
+				finish(*it);
+				it = jobs.erase(it);
+			}
+
+			for (auto it = _errors.begin(); it != _errors.end();)
+				it = registered(it->first, it->second.serial) ? std::next(it) : _errors.erase(it);
+		}
+
+		const auto& errors() const { return _errors; }
+		std::size_t pending() const { return jobs.size(); }
+		std::size_t reloaded() const { return _reloaded; }
+		bool parallelCompile() const { return parallel; }
+		bool nativeWatcher() const { return watcher.native(); }
+	};
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Shader.h"
+
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The programs built from one vertex + fragment pair with different #defines. Every option is a define with a small
+// integer value; a combination is compiled the first time it is asked for and kept, so startup only pays for the
+// variants actually drawn with.
+class ShaderVariants final
+{
+public:
+	struct Option
+	{
+		std::string define;
+		int count; // values 0 .. count - 1
+	};
+
+private:
+	const std::filesystem::path vertex, fragment;
+	const std::vector<Option> options;
+	std::unordered_map<std::uint32_t, std::unique_ptr<Shader>> variants;
+
+public:
+	ShaderVariants(std::filesystem::path vertex, std::filesystem::path fragment, std::vector<Option> options)
+		: vertex(std::move(vertex))
+		, fragment(std::move(fragment))
+		, options(std::move(options))
+	{
+	}
+
+	// one value per option, in the order the options were given
+	Shader& get(std::initializer_list<int> values)
+	{
+		return get<std::initializer_list<int>>(values);
+	}
+
+	template<class Values>
+	Shader& get(const Values& values)
+	{
+		assert(values.size() == options.size());
+
+		auto key = std::uint32_t{ 0 };
+		auto option = options.begin();
+		for (const auto value : values)
+		{
+			assert(value >= 0 && value < option->count);
+			key = key * option->count + value;
+			++option;
+		}
+
+		if (const auto variant = variants.find(key); variant != variants.end())
+			return *variant->second;
+
+		auto defines = std::vector<std::string>{};
+		option = options.begin();
+		for (const auto value : values)
+			defines.push_back((option++)->define + " " + std::to_string(value));
+		return *variants.emplace(key, std::make_unique<Shader>(vertex, fragment, std::move(defines))).first->second;
+	}
+
+	std::size_t compiled() const { return variants.size(); }
+};
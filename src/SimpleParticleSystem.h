@@ -1,6 +1,11 @@
 #pragma once
 
 #include "Shader.h"
+#include "GLState.h"
+#include "GLObjects.h"
+#include "Random.h"
+#include "ParticleProperties.h"
+#include "Profiler.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtx/compatibility.hpp>
@@ -14,22 +19,11 @@
 #include <random>
 #include <algorithm>
 
-namespace rng
-{
-    auto Float()
-    {
-        static std::random_device rd{};
-        static auto seed = std::mt19937{ rd() };
-        static auto distribution = std::uniform_real_distribution<float>(-0.002f, 0.002f);
-
-        return distribution(seed);
-    }
-}
-
 class SimpleParticleSystem final
 {
-    const GLuint VAO, VBO, EBO, textureId, FBO;
-    const Shader shader;
+    const gl::VertexArray VAO;
+    const gl::Buffer VBO, EBO;
+    Shader shader;
 
     struct Particle
     {
@@ -49,31 +43,25 @@ class SimpleParticleSystem final
 
     std::size_t size = sizeof(Particle);
 
-    struct
-    {
-        glm::vec3 initialVelocity = { 0.f, 0.f, 0.f };
-        glm::vec3 acceleration = { 0.f, 0.f, 0.f };
-        glm::vec4 startColor = { 0.f, 0.5f, 1.f, 1.f };
-        glm::vec4 endColor = { 1.f, 0.f, 0.f, 1.f };
-        int totalLifetimeSeconds = 5;
-        int spawnCount = 50;
-        float scale = 0.0025f;
-        int particleShape = 1; // 0 - square, 1 - circle // TODO enum or sth (fast impl for imgui exposure)...
-        float shapeThickness = 0.8f;
-        bool randomVelocity = true;
-        bool randomAcceleration = false;
-    } properties;
+    ParticleProperties properties;
 
     const std::size_t particlesLimit;
 
+    struct Instance
+    {
+        glm::mat4 model;
+        glm::vec4 color;
+    };
+
+    std::vector<Instance> instances;
+    std::size_t instancesCount = 0;
+
 public:
 
-    SimpleParticleSystem(unsigned int poolCount, unsigned width, unsigned height)
+    explicit SimpleParticleSystem(unsigned int poolCount)
         : VAO(gl::genVertexArray())
         , VBO(gl::genBuffer())
         , EBO(gl::genBuffer())
-        , textureId(gl::genTexture(width, height))
-        , FBO(gl::genFramebuffer(textureId))
         , shader("simpleParticleSystem.glsl")
         , particlesLimit(poolCount)
     {
@@ -105,6 +93,8 @@ public:
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
+
+        instances.resize(poolCount);
     }
 
     auto& startColor() { return properties.startColor; }
@@ -119,8 +109,8 @@ public:
     auto& acceleration() { return properties.acceleration; }
     auto& randomVelocity() { return properties.randomVelocity; }
     auto& randomAcceleration() { return properties.randomAcceleration; }
+    auto& props() { return properties; }
 
-    auto texture() { return textureId; }
 
     void emit(glm::vec3 worldPos, float t)
     {
@@ -161,21 +151,24 @@ public:
         }
     }
 
-    void draw(glm::mat4 view, glm::mat4 projection, float currentTime)
+    // view/projection come from the Camera uniform block (CameraBuffer)
+    void draw(float currentTime, GLuint framebuffer)
     {
-        const auto totalLifetimeSeconds = properties.totalLifetimeSeconds;
+        // draws the particles where they were before this frame's step
+        fill(currentTime);
+        update(currentTime);
+        render(framebuffer);
+    }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-        gl::checkError();
+    // stages of draw() exposed separately so they can be measured on their own; there is nothing to upload here
+    void update(float currentTime)
+    {
+        PROFILE_CPU_SCOPE("particles update");
 
-        glClearColor(0.f, 0.f, 0.f, 0.f);
-        gl::checkError();
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        gl::checkError();
+        const auto totalLifetimeSeconds = properties.totalLifetimeSeconds;
 
-        for (auto particleIt = aliveParticles.rbegin(); particleIt != aliveParticles.rend(); particleIt++)
+        for (auto& particle : aliveParticles)
         {
-            auto& particle = *particleIt;
             const auto particleLifetime = currentTime - particle.creationTime;
             if (particleLifetime > totalLifetimeSeconds)
             {
@@ -184,42 +177,57 @@ public:
 
             if (particle.isAlive)
             {
-                const auto progress = particleLifetime / float(totalLifetimeSeconds);
-                const auto color = glm::lerp(particle.startColor, particle.endColor, progress);
-                auto model = glm::mat4(1.0f);
-                model = glm::translate(model, particle.position);
-                model = glm::rotate(model, particle.rotationSpeed * progress, glm::vec3(0, 0, 1));
-                model = glm::scale(model, glm::vec3{ particle.scale, particle.scale, particle.scale });
-
-                shader.use();
-                shader.setMat4("model", model);
-                shader.setMat4("view", view);
-                shader.setMat4("projection", projection);
-                shader.setVec4("color", color);
-
-                glBindVertexArray(VAO);
-                gl::checkError();
-                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-                gl::checkError();
-
                 particle.position += particle.velocity;
                 particle.velocity += particle.acceleration;
             }
         }
 
         aliveParticles.remove_if([](const auto& p) { return !p.isAlive; });
+    }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        gl::checkError();
+    void fill(float currentTime)
+    {
+        PROFILE_CPU_SCOPE("particles fill");
+
+        const auto totalLifetimeSeconds = properties.totalLifetimeSeconds;
+
+        instancesCount = 0;
+        for (auto particleIt = aliveParticles.rbegin(); particleIt != aliveParticles.rend(); particleIt++)
+        {
+            const auto& particle = *particleIt;
+            const auto particleLifetime = currentTime - particle.creationTime;
+            if (particleLifetime > totalLifetimeSeconds)
+                continue; // update() drops it this frame
+            const auto progress = particleLifetime / float(totalLifetimeSeconds);
+
+            auto& instance = instances[instancesCount++];
+            instance.color = glm::lerp(particle.startColor, particle.endColor, progress);
+            instance.model = glm::mat4(1.0f);
+            instance.model = glm::translate(instance.model, particle.position);
+            instance.model = glm::rotate(instance.model, particle.rotationSpeed * progress, glm::vec3(0, 0, 1));
+            instance.model = glm::scale(instance.model, glm::vec3{ particle.scale, particle.scale, particle.scale });
+        }
     }
 
-    void resize(unsigned int width, unsigned int height)
+    void render(GLuint framebuffer)
     {
-        glBindTexture(GL_TEXTURE_2D, textureId);
-        gl::checkError();
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        PROFILE_SCOPE("particles render");
+
+        gl::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glClearColor(0.f, 0.f, 0.f, 0.f);
         gl::checkError();
-        glBindTexture(GL_TEXTURE_2D, textureId);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         gl::checkError();
+
+        for (auto i = std::size_t{ 0 }; i < instancesCount; i++)
+        {
+            shader.use();
+            shader.setMat4("model", instances[i].model);
+            shader.setVec4("color", instances[i].color);
+
+            gl::bindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            gl::checkError();
+        }
     }
 };
@@ -0,0 +1,323 @@
+#pragma once
+
+#include "InstancedParticleSystem.h"
+#include "ParticleProperties.h"
+#include "ParticleStore.h"
+#include "Camera.h"
+#include "Random.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Full simulation state on disk: live particles, emitter properties, camera, sim time and rng state.
+//
+// layout (little endian, native float):
+//   Header
+//   ColumnEntry[header.columnCount]
+//   rng state (text, as written by std::mt19937::operator<<)
+//   one array per ParticleStore column, each starting at a multiple of ALIGNMENT
+// Columns are copied out of the mapped file with one memcpy each, only the rng state is parsed.
+namespace snapshot
+{
+	constexpr auto MAGIC = std::uint32_t{ 0x504e5350 }; // "PSNP"
+	constexpr auto VERSION = std::uint32_t{ 1 };
+	constexpr auto ALIGNMENT = std::size_t{ 64 };
+
+	struct Header
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint64_t particleCount;
+		std::uint32_t columnCount;
+		float simTime;
+		glm::vec3 cameraPosition;
+		float cameraFov;
+
+		// ParticleProperties, spelled out so the layout does not depend on the struct
+		glm::vec3 initialVelocity;
+		glm::vec3 acceleration;
+		glm::vec4 startColor;
+		glm::vec4 endColor;
+		std::int32_t totalLifetimeSeconds;
+		std::int32_t spawnCount;
+		float scale;
+		std::int32_t particleShape;
+		float shapeThickness;
+		std::uint8_t randomVelocity;
+		std::uint8_t randomAcceleration;
+		std::uint8_t reserved[2];
+
+		std::uint64_t rngStateOffset;
+		std::uint64_t rngStateSize;
+	};
+
+	struct ColumnEntry
+	{
+		std::uint32_t id; // ParticleStore::Column
+		std::uint32_t elementSize;
+		std::uint64_t offset; // from the start of the file
+	};
+
+	static_assert(std::is_trivially_copyable_v<Header>);
+	static_assert(sizeof(Header) == 136, "Header must not contain padding");
+	static_assert(sizeof(ColumnEntry) == 16);
+
+	constexpr std::size_t alignUp(std::size_t value)
+	{
+		return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	}
+
+	// Read-only view of a whole file. mmap where available, otherwise the file is read into memory.
+	class MappedFile final
+	{
+		const char* _data = nullptr;
+		std::size_t _size = 0;
+#ifdef _WIN32
+		std::vector<char> buffer;
+#endif
+
+	public:
+		explicit MappedFile(const std::filesystem::path& path)
+		{
+#ifdef _WIN32
+			auto file = std::ifstream(path, std::ios::binary);
+			if (!file.is_open())
+				throw std::runtime_error("Could not open file:" + path.string());
+			buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			_data = buffer.data();
+			_size = buffer.size();
+#else
+			const auto fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				throw std::runtime_error("Could not open file:" + path.string());
+
+			struct stat info {};
+			if (::fstat(fd, &info) != 0 || info.st_size == 0)
+			{
+				::close(fd);
+				throw std::runtime_error("Could not read file:" + path.string());
+			}
+			_size = static_cast<std::size_t>(info.st_size);
+
+			auto* mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (mapping == MAP_FAILED)
+				throw std::runtime_error("Could not map file:" + path.string());
+			_data = static_cast<const char*>(mapping);
+#endif
+		}
+
+		~MappedFile()
+		{
+#ifndef _WIN32
+			if (_data)
+				::munmap(const_cast<char*>(_data), _size);
+#endif
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const char* data() const { return _data; }
+		std::size_t size() const { return _size; }
+	};
+
+	void save(const std::filesystem::path& path, InstancedParticleSystem& particleSystem, Camera& camera, float simTime)
+	{
+		const auto& store = particleSystem.store();
+		const auto& properties = particleSystem.props();
+
+		auto rngState = std::ostringstream{};
+		rngState << rng::engine();
+		const auto rngText = rngState.str();
+
+		auto header = Header{};
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.particleCount = store.size();
+		header.simTime = simTime;
+		header.cameraPosition = camera.position();
+		header.cameraFov = camera.fov();
+		header.initialVelocity = properties.initialVelocity;
+		header.acceleration = properties.acceleration;
+		header.startColor = properties.startColor;
+		header.endColor = properties.endColor;
+		header.totalLifetimeSeconds = properties.totalLifetimeSeconds;
+		header.spawnCount = properties.spawnCount;
+		header.scale = properties.scale;
+		header.particleShape = properties.particleShape;
+		header.shapeThickness = properties.shapeThickness;
+		header.randomVelocity = properties.randomVelocity;
+		header.randomAcceleration = properties.randomAcceleration;
+
+		auto columns = std::vector<ColumnEntry>{};
+		store.forEachColumn([&columns](ParticleStore::Column id, const auto& column)
+		{
+			using T = typename std::decay_t<decltype(column)>::value_type;
+			columns.push_back(ColumnEntry{ static_cast<std::uint32_t>(id), sizeof(T), 0 });
+		});
+		header.columnCount = static_cast<std::uint32_t>(columns.size());
+
+		auto offset = sizeof(Header) + sizeof(ColumnEntry) * columns.size();
+		header.rngStateOffset = offset;
+		header.rngStateSize = rngText.size();
+		offset += rngText.size();
+		for (auto& column : columns)
+		{
+			column.offset = alignUp(offset);
+			offset = column.offset + column.elementSize * store.size();
+		}
+
+		auto file = std::ofstream(path, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file:" + path.string());
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(columns.data()), sizeof(ColumnEntry) * columns.size());
+		file.write(rngText.data(), rngText.size());
+
+		auto written = header.rngStateOffset + rngText.size();
+		auto index = std::size_t{ 0 };
+		store.forEachColumn([&](ParticleStore::Column, const auto& column)
+		{
+			static constexpr char ZEROS[ALIGNMENT] = {};
+			const auto& entry = columns[index++];
+			file.write(ZEROS, entry.offset - written);
+
+			const auto bytes = column.size() * entry.elementSize;
+			file.write(reinterpret_cast<const char*>(column.data()), bytes);
+			written = entry.offset + bytes;
+		});
+
+		if (!file)
+			throw std::runtime_error("Could not write snapshot:" + path.string());
+	}
+
+	// A mapped snapshot. Everything is validated up front, column() then hands out pointers into the mapping.
+	class Snapshot final
+	{
+		MappedFile file;
+		Header _header{};
+		const ColumnEntry* columns = nullptr;
+
+	public:
+		explicit Snapshot(const std::filesystem::path& path)
+			: file(path)
+		{
+			if (file.size() < sizeof(Header))
+				throw std::runtime_error("Not a snapshot: " + path.string());
+
+			std::memcpy(&_header, file.data(), sizeof(Header));
+			if (_header.magic != MAGIC)
+				throw std::runtime_error("Not a snapshot: " + path.string());
+			if (_header.version != VERSION)
+				throw std::runtime_error("Unsupported snapshot version " + std::to_string(_header.version));
+
+			const auto directoryEnd = sizeof(Header) + sizeof(ColumnEntry) * std::size_t{ _header.columnCount };
+			if (directoryEnd > file.size() || _header.rngStateOffset + _header.rngStateSize > file.size())
+				throw std::runtime_error("Snapshot is truncated");
+			columns = reinterpret_cast<const ColumnEntry*>(file.data() + sizeof(Header));
+
+			for (auto i = std::uint32_t{ 0 }; i < _header.columnCount; ++i)
+			{
+				const auto& column = columns[i];
+				if (column.offset % ALIGNMENT != 0 || column.offset + column.elementSize * _header.particleCount > file.size())
+					throw std::runtime_error("Snapshot is truncated");
+			}
+		}
+
+		const Header& header() const { return _header; }
+		std::size_t particleCount() const { return static_cast<std::size_t>(_header.particleCount); }
+		std::string_view rngState() const { return { file.data() + _header.rngStateOffset, static_cast<std::size_t>(_header.rngStateSize) }; }
+
+		// pointer to the column inside the mapping, nullptr if the snapshot does not have it
+		template<class T>
+		const T* column(ParticleStore::Column id) const
+		{
+			for (auto i = std::uint32_t{ 0 }; i < _header.columnCount; ++i)
+			{
+				if (columns[i].id != static_cast<std::uint32_t>(id))
+					continue;
+				if (columns[i].elementSize != sizeof(T))
+					throw std::runtime_error("Snapshot column " + std::to_string(columns[i].id) + " has unexpected element size");
+				return reinterpret_cast<const T*>(file.data() + columns[i].offset);
+			}
+			return nullptr;
+		}
+	};
+
+	// Replaces the particle state, emitter properties, camera and rng with the snapshot and returns its sim time.
+	float restore(const Snapshot& snapshot, InstancedParticleSystem& particleSystem, Camera& camera)
+	{
+		const auto count = snapshot.particleCount();
+		if (count > particleSystem.poolSize())
+			throw std::runtime_error("Snapshot has " + std::to_string(count) + " particles, the pool only " + std::to_string(particleSystem.poolSize()));
+
+		// everything that can fail runs before the first write, a rejected snapshot leaves the simulation as it was
+		auto& store = particleSystem.store();
+		auto sources = std::vector<const void*>{};
+		std::as_const(store).forEachColumn([&](ParticleStore::Column id, const auto& column)
+		{
+			using T = typename std::decay_t<decltype(column)>::value_type;
+			const auto* source = snapshot.column<T>(id);
+			if (!source)
+				throw std::runtime_error("Snapshot is missing column " + std::to_string(static_cast<std::uint32_t>(id)));
+			sources.push_back(source);
+		});
+
+		auto engine = rng::engine();
+		auto rngState = std::istringstream(std::string(snapshot.rngState()));
+		rngState >> engine;
+		if (rngState.fail())
+			throw std::runtime_error("Snapshot has an invalid rng state");
+
+		store.resize(count);
+		auto index = std::size_t{ 0 };
+		store.forEachColumn([&](ParticleStore::Column, auto& column)
+		{
+			using T = typename std::decay_t<decltype(column)>::value_type;
+			std::memcpy(column.data(), sources[index++], count * sizeof(T));
+		});
+
+		const auto& header = snapshot.header();
+		auto& properties = particleSystem.props();
+		properties.initialVelocity = header.initialVelocity;
+		properties.acceleration = header.acceleration;
+		properties.startColor = header.startColor;
+		properties.endColor = header.endColor;
+		properties.totalLifetimeSeconds = header.totalLifetimeSeconds;
+		properties.spawnCount = header.spawnCount;
+		properties.scale = header.scale;
+		properties.particleShape = header.particleShape;
+		properties.shapeThickness = header.shapeThickness;
+		properties.randomVelocity = header.randomVelocity != 0;
+		properties.randomAcceleration = header.randomAcceleration != 0;
+
+		camera.position() = header.cameraPosition;
+		camera.fov() = header.cameraFov;
+
+		rng::engine() = engine;
+
+		return header.simTime;
+	}
+}
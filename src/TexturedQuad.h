@@ -1,10 +1,13 @@
 #pragma once
 
 #include "OpenGLUtils.h"
+#include "GLDebug.h"
+#include "GLObjects.h"
 
 class TexturedQuad final
 {
-	const GLuint _VAO, _VBO, _EBO;
+	const gl::VertexArray _VAO;
+	const gl::Buffer _VBO, _EBO;
 
 public:
 	TexturedQuad()
@@ -45,17 +48,9 @@ public:
 		gl::checkError();
 
 		glBindVertexArray(0);
-	}
 
-	~TexturedQuad()
-	{
-		glDeleteBuffers(1, &_VBO);
-		gl::checkError();
-		glDeleteBuffers(1, &_EBO);
-		gl::checkError();
-		glDeleteVertexArrays(1, &_VAO);
-		gl::checkError();
+		gl::label(GL_VERTEX_ARRAY, _VAO, "textured quad");
 	}
 
-	auto VAO() const { return _VAO; }
+	GLuint VAO() const { return _VAO; }
 };
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "RenderGraph.h"
+
+// HDR colour to display range, the tonemap stage of composite.frag; folded into the composite like the bloom
+class Tonemap final
+{
+public:
+	enum class Operator : int
+	{
+		None,
+		Reinhard,
+		Aces
+	};
+
+private:
+	Operator _op = Operator::Aces;
+	float _exposure = 1.f;
+
+public:
+	auto& op() { return _op; }
+	auto& exposure() { return _exposure; }
+
+	// output is display range, rgb8 is enough for it
+	void addTo(gl::RenderGraph& graph, gl::RenderGraph::Resource hdr, gl::RenderGraph::Resource output)
+	{
+		graph.addPointwise("tonemap", { hdr }, output, { gl::RenderGraph::Stage::Tonemap, {}, [this](const Shader& shader)
+		{
+			shader.setFloat("exposure", _exposure);
+		}, static_cast<int>(_op) });
+	}
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "Profiler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace profiler
+{
+	// Captures the next N profiled frames into a Chrome Trace Event JSON file (chrome://tracing, ui.perfetto.dev).
+	// Frames are copied into a bounded queue and serialised on a background thread; when the writer falls behind,
+	// frames are dropped rather than growing the queue. While idle the only cost is one atomic load per frame.
+	class TraceCapture final
+	{
+		static constexpr std::size_t MAX_QUEUED_FRAMES = 64;
+		static constexpr auto GPU_TID = 1000;
+		static constexpr auto FRAMES_TID = 1001;
+
+		Profiler& profiler;
+		const int listenerId;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<Frame> queue;
+		bool finishing = false;
+		std::thread writer;
+
+		std::atomic<int> remaining = 0;
+		std::atomic<std::size_t> written = 0, dropped = 0;
+		std::string _path;
+
+		void onFrame(const Frame& frame)
+		{
+			if (remaining.load(std::memory_order_relaxed) <= 0)
+				return;
+
+			{
+				const auto lock = std::lock_guard(mutex);
+				if (queue.size() < MAX_QUEUED_FRAMES)
+					queue.push_back(frame);
+				else
+					dropped++;
+
+				if (--remaining == 0)
+					finishing = true;
+			}
+			condition.notify_one();
+		}
+
+		static void writeEscaped(std::ostream& out, const std::string& text)
+		{
+			for (const auto c : text)
+			{
+				if (c == '"' || c == '\\')
+					out << '\\';
+				out << c;
+			}
+		}
+
+		static void writeEvent(std::ostream& out, bool& first, const char* name, const char* category, std::int64_t begin, std::int64_t end, std::int64_t origin, int tid)
+		{
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "{\"name\":\"";
+			writeEscaped(out, name);
+			out << "\",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+				<< ",\"ts\":" << (begin - origin) / 1000.0 << ",\"dur\":" << (end - begin) / 1000.0 << "}";
+		}
+
+		void write()
+		{
+			auto out = std::ofstream(_path);
+			if (!out.is_open())
+			{
+				std::cerr << "Could not open file:" << _path << std::endl;
+				remaining = 0;
+				return;
+			}
+			out.precision(3);
+			out << std::fixed;
+
+			auto first = true;
+			out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+			const auto threadName = [&](int tid, const std::string& name)
+			{
+				out << (first ? "\n" : ",\n");
+				first = false;
+				out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\"";
+				writeEscaped(out, name);
+				out << "\"}}";
+			};
+			threadName(GPU_TID, "GPU");
+			threadName(FRAMES_TID, "Frames");
+
+			// threads are named when their track first shows up, they may register after the capture started
+			auto named = std::set<std::uint32_t>{};
+			const auto nameTrack = [&](std::uint32_t track)
+			{
+				if (!named.insert(track).second)
+					return;
+				Registry::get().forEach([&](ThreadBuffer& buffer)
+				{
+					if (buffer.track == track)
+						threadName(static_cast<int>(track), buffer.name);
+				});
+			};
+
+			auto origin = std::int64_t{ -1 };
+			for (;;)
+			{
+				auto frame = Frame{};
+				{
+					auto lock = std::unique_lock(mutex);
+					condition.wait(lock, [&] { return !queue.empty() || finishing; });
+					if (queue.empty())
+						break;
+
+					frame = std::move(queue.front());
+					queue.pop_front();
+				}
+
+				if (origin < 0)
+					origin = frame.begin;
+
+				const auto frameName = "frame " + std::to_string(frame.index);
+				writeEvent(out, first, frameName.c_str(), "frame", frame.begin, frame.end, origin, FRAMES_TID);
+				for (const auto& event : frame.cpu)
+				{
+					nameTrack(event.track);
+					writeEvent(out, first, event.name, "cpu", event.begin, event.end, origin, event.track);
+				}
+				for (const auto& event : frame.gpu)
+					writeEvent(out, first, event.name, "gpu", event.begin, event.end, origin, GPU_TID);
+
+				written++;
+			}
+
+			out << "\n]}\n";
+		}
+
+	public:
+		explicit TraceCapture(Profiler& profiler)
+			: profiler(profiler)
+			, listenerId(profiler.addListener([this](const Frame& frame) { onFrame(frame); }))
+		{
+		}
+
+		TraceCapture(const TraceCapture&) = delete;
+		TraceCapture& operator=(const TraceCapture&) = delete;
+
+		~TraceCapture()
+		{
+			profiler.removeListener(listenerId);
+			finish();
+		}
+
+		void start(std::string path, int frames)
+		{
+			finish();
+
+			_path = std::move(path);
+			written = 0;
+			dropped = 0;
+			finishing = false;
+
+			remaining = frames;
+			writer = std::thread(&TraceCapture::write, this);
+		}
+
+		// stops capturing and waits for the writer to flush the file
+		void finish()
+		{
+			{
+				const auto lock = std::lock_guard(mutex);
+				finishing = true;
+				remaining = 0;
+			}
+			condition.notify_one();
+
+			if (writer.joinable())
+				writer.join();
+		}
+
+		bool capturing() const { return remaining > 0; }
+		int remainingFrames() const { return remaining; }
+		std::size_t writtenFrames() const { return written; }
+		std::size_t droppedFrames() const { return dropped; }
+		const std::string& path() const { return _path; }
+	};
+}
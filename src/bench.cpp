@@ -0,0 +1,341 @@
+#include "HeadlessContext.h"
+#include "Random.h"
+#include "SimpleParticleSystem.h"
+#include "BatchParticleSystem.h"
+#include "InstancedParticleSystem.h"
+#include "Snapshot.h"
+#include "Camera.h"
+#include "CameraBuffer.h"
+#include "RenderTargets.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		std::vector<std::string> systems = { "simple", "batch", "instanced", "instanced-points" };
+		std::vector<unsigned int> counts = { 10'000, 100'000, 500'000, 2'000'000 };
+		unsigned int frames = 60;
+		unsigned int warmupFrames = 10;
+		unsigned int width = 1920;
+		unsigned int height = 1080;
+		std::string format = "json";
+		std::string output;
+		std::string snapshotPath; // instanced runs start from this snapshot instead of warming up
+		std::string saveSnapshotPath; // instanced state after the warm-up is written here
+	};
+
+	struct PhaseStats
+	{
+		double mean = 0.0;
+		double min = std::numeric_limits<double>::max();
+		double max = 0.0;
+
+		void add(double ms)
+		{
+			mean += ms;
+			min = std::min(min, ms);
+			max = std::max(max, ms);
+		}
+	};
+
+	struct Result
+	{
+		std::string system;
+		unsigned int particles = 0;
+		std::size_t alive = 0;
+		unsigned int verticesPerParticle = 4;
+		PhaseStats update, fill, upload, draw;
+
+		// vertex throughput of the draw, a quad is 4 vertices (6 indices), a point sprite 1
+		std::size_t vertices() const { return alive * verticesPerParticle; }
+		double drawMVerticesPerSecond() const { return vertices() / std::max(draw.mean, 1e-6) / 1e3; }
+	};
+
+	constexpr auto SEED = 1234u;
+	constexpr auto DELTA_TIME = 1.f / 60.f;
+
+	template<class Function>
+	double measure(Function&& function)
+	{
+		const auto t1 = std::chrono::steady_clock::now();
+		function();
+		const auto t2 = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::milli>(t2 - t1).count();
+	}
+
+	template<class ParticleSystem>
+	void upload(ParticleSystem& particleSystem) { particleSystem.upload(); }
+
+	void upload(SimpleParticleSystem&) {} // uniforms are set per particle in render()
+
+	// Every system is driven through the same script: the pool is filled from a ring of emitters during the warm-up
+	// frames (with a lifetime long enough that nothing dies), then each stage of the frame is measured separately.
+	// GPU work is finished after upload and draw so their times are not folded into the next stage.
+	// The instanced system can skip the warm-up by restoring a snapshot, which takes milliseconds instead of
+	// emitting for minutes at high counts.
+	template<class ParticleSystem>
+	Result run(const std::string& name, unsigned int count, const Options& options)
+	{
+		constexpr auto SNAPSHOTS = std::is_same_v<ParticleSystem, InstancedParticleSystem>;
+
+		rng::seed(SEED);
+
+		auto warmState = std::optional<snapshot::Snapshot>{};
+		if (SNAPSHOTS && !options.snapshotPath.empty())
+		{
+			warmState.emplace(options.snapshotPath);
+			count = static_cast<unsigned int>(warmState->particleCount());
+		}
+
+		auto targets = gl::RenderTargetPool(options.width, options.height);
+		const auto target = targets.acquire();
+		auto particleSystem = ParticleSystem(count);
+		particleSystem.totalLifetimeSeconds() = 1000;
+		if constexpr (SNAPSHOTS)
+		{
+			if (name == "instanced-matrix")
+				particleSystem.instanceFormat() = InstancedParticleSystem::InstanceFormat::Matrix;
+			// quads unless asked for points, whatever size the particles end up at
+			particleSystem.pointSpritesBelow() = name == "instanced-points" ? std::numeric_limits<float>::max() : 0.f;
+		}
+
+		auto camera = Camera{};
+		auto t = 0.f;
+		if constexpr (SNAPSHOTS)
+		{
+			if (warmState)
+			{
+				const auto ms = measure([&] { t = snapshot::restore(*warmState, particleSystem, camera); });
+				std::cerr << "restored " << warmState->particleCount() << " particles in " << ms << " ms" << std::endl;
+			}
+		}
+		auto cameraBuffer = CameraBuffer{};
+		cameraBuffer.update(camera.view(), camera.projection(options.width, options.height), glm::vec2(options.width, options.height));
+		if constexpr (SNAPSHOTS)
+			particleSystem.lodCamera(camera.view(), camera.projection(options.width, options.height), static_cast<float>(options.height));
+
+		if (!warmState)
+		{
+			const auto perFrame = (count + options.warmupFrames - 1) / options.warmupFrames;
+			for (auto frame = 0u; frame < options.warmupFrames; ++frame, t += DELTA_TIME)
+			{
+				const auto angle = 2.f * 3.14159265f * frame / options.warmupFrames;
+				particleSystem.spawnCount() = std::min<std::size_t>(perFrame, count - particleSystem.aliveParticlesCount());
+				particleSystem.emit(glm::vec3{ std::cos(angle), std::sin(angle), 0.f }, t);
+				particleSystem.draw(t, target.framebuffer());
+			}
+		}
+		glFinish();
+
+		if constexpr (SNAPSHOTS)
+		{
+			if (!options.saveSnapshotPath.empty())
+				snapshot::save(options.saveSnapshotPath, particleSystem, camera, t);
+		}
+
+		auto result = Result{};
+		result.system = name;
+		result.particles = count;
+		for (auto frame = 0u; frame < options.frames; ++frame, t += DELTA_TIME)
+		{
+			result.fill.add(measure([&] { particleSystem.fill(t); }));
+			result.update.add(measure([&] { particleSystem.update(t); }));
+			result.upload.add(measure([&] { upload(particleSystem); glFinish(); }));
+			result.draw.add(measure([&] { particleSystem.render(target.framebuffer()); glFinish(); }));
+		}
+
+		for (auto* stats : { &result.update, &result.fill, &result.upload, &result.draw })
+			stats->mean /= std::max(options.frames, 1u);
+		result.alive = particleSystem.aliveParticlesCount();
+		if constexpr (SNAPSHOTS)
+			result.verticesPerParticle = particleSystem.pointSprites() ? 1 : 4;
+
+		return result;
+	}
+
+	std::vector<std::string> split(const std::string& list)
+	{
+		auto values = std::vector<std::string>{};
+		auto stream = std::istringstream(list);
+		for (auto value = std::string{}; std::getline(stream, value, ',');)
+			values.push_back(value);
+		return values;
+	}
+
+	Options parseOptions(int argc, char** argv)
+	{
+		auto options = Options{};
+		for (auto i = 1; i < argc; ++i)
+		{
+			const auto arg = std::string(argv[i]);
+			const auto next = [&]() -> std::string
+			{
+				if (i + 1 >= argc)
+					throw std::runtime_error("Missing value for " + arg);
+				return argv[++i];
+			};
+
+			if (arg == "--systems")
+				options.systems = split(next());
+			else if (arg == "--counts")
+			{
+				options.counts.clear();
+				for (const auto& count : split(next()))
+					options.counts.push_back(std::stoul(count));
+			}
+			else if (arg == "--frames")
+				options.frames = std::stoul(next());
+			else if (arg == "--warmup")
+				options.warmupFrames = std::max(1ul, std::stoul(next()));
+			else if (arg == "--size")
+			{
+				const auto size = split(next());
+				if (size.size() != 2)
+					throw std::runtime_error("--size expects WIDTH,HEIGHT");
+				options.width = std::stoul(size[0]);
+				options.height = std::stoul(size[1]);
+			}
+			else if (arg == "--format")
+				options.format = next();
+			else if (arg == "--output")
+				options.output = next();
+			else if (arg == "--snapshot")
+				options.snapshotPath = next();
+			else if (arg == "--save-snapshot")
+				options.saveSnapshotPath = next();
+			else if (arg == "--help")
+			{
+				std::cout << "usage: particles_bench [--systems simple,batch,instanced,instanced-matrix,instanced-points] [--counts 10000,100000,...] [--frames N]\n"
+							 "                       [--warmup N] [--size W,H] [--format json|csv] [--output FILE]\n"
+							 "                       [--snapshot FILE] [--save-snapshot FILE]\n"
+							 "--snapshot replaces the warm-up of the instanced system (and its --counts) with a saved state\n";
+				std::exit(EXIT_SUCCESS);
+			}
+			else
+				throw std::runtime_error("Unknown argument: " + arg);
+		}
+
+		if (options.format != "json" && options.format != "csv")
+			throw std::runtime_error("Unknown format: " + options.format);
+
+		return options;
+	}
+
+	void writeJson(std::ostream& out, const Options& options, const std::vector<Result>& results)
+	{
+		const auto phase = [&](const char* name, const PhaseStats& stats, bool last)
+		{
+			out << "\"" << name << "_ms\": { \"mean\": " << stats.mean << ", \"min\": " << stats.min << ", \"max\": " << stats.max << " }" << (last ? "" : ", ");
+		};
+
+		out << "{\n";
+		out << "  \"renderer\": \"" << glGetString(GL_RENDERER) << "\",\n";
+		out << "  \"version\": \"" << glGetString(GL_VERSION) << "\",\n";
+		out << "  \"width\": " << options.width << ",\n";
+		out << "  \"height\": " << options.height << ",\n";
+		out << "  \"frames\": " << options.frames << ",\n";
+		out << "  \"results\": [\n";
+		for (auto i = std::size_t{ 0 }; i < results.size(); ++i)
+		{
+			const auto& result = results[i];
+			out << "    { \"system\": \"" << result.system << "\", \"particles\": " << result.particles << ", \"alive\": " << result.alive << ", ";
+			out << "\"vertices\": " << result.vertices() << ", \"draw_mvertices_per_s\": " << result.drawMVerticesPerSecond() << ", ";
+			phase("update", result.update, false);
+			phase("fill", result.fill, false);
+			phase("upload", result.upload, false);
+			phase("draw", result.draw, true);
+			out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n";
+		out << "}\n";
+	}
+
+	void writeCsv(std::ostream& out, const std::vector<Result>& results)
+	{
+		out << "system,particles,alive,vertices,draw_mvertices_per_s,phase,mean_ms,min_ms,max_ms\n";
+		for (const auto& result : results)
+		{
+			const std::pair<const char*, const PhaseStats*> phases[] = {
+				{ "update", &result.update }, { "fill", &result.fill }, { "upload", &result.upload }, { "draw", &result.draw }
+			};
+			for (const auto& [name, stats] : phases)
+				out << result.system << "," << result.particles << "," << result.alive << "," << result.vertices() << "," << result.drawMVerticesPerSecond() << "," << name << "," << stats->mean << "," << stats->min << "," << stats->max << "\n";
+		}
+	}
+}
+
+int main(int argc, char** argv) try
+{
+	const auto options = parseOptions(argc, argv);
+
+	auto context = HeadlessContext(options.width, options.height);
+	std::cerr << "Renderer: " << glGetString(GL_RENDERER) << " (" << glGetString(GL_VERSION) << ")" << std::endl;
+
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glViewport(0, 0, options.width, options.height);
+
+	auto results = std::vector<Result>{};
+	for (const auto& system : options.systems)
+	{
+		// a snapshot fixes the particle count, run it once
+		if ((system == "instanced" || system == "instanced-matrix" || system == "instanced-points") && !options.snapshotPath.empty())
+		{
+			std::cerr << system << " from " << options.snapshotPath << "..." << std::endl;
+			results.push_back(run<InstancedParticleSystem>(system, 0, options));
+			continue;
+		}
+
+		for (const auto count : options.counts)
+		{
+			std::cerr << system << " " << count << "..." << std::endl;
+
+			if (system == "simple")
+				results.push_back(run<SimpleParticleSystem>(system, count, options));
+			else if (system == "batch")
+				results.push_back(run<BatchParticleSystem>(system, count, options));
+			else if (system == "instanced" || system == "instanced-matrix" || system == "instanced-points")
+				results.push_back(run<InstancedParticleSystem>(system, count, options));
+			else
+				throw std::runtime_error("Unknown particle system: " + system);
+		}
+	}
+
+	auto file = std::ofstream{};
+	if (!options.output.empty())
+	{
+		file.open(options.output);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file:" + options.output);
+	}
+	auto& out = options.output.empty() ? std::cout : file;
+
+	if (options.format == "json")
+		writeJson(out, options, results);
+	else
+		writeCsv(out, results);
+
+	return EXIT_SUCCESS;
+}
+catch (const std::exception& e)
+{
+	std::cerr << e.what() << std::endl;
+	return EXIT_FAILURE;
+}
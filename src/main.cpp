@@ -9,10 +9,26 @@
 //#include "SimpleParticleSystem.h"
 //#include "BatchParticleSystem.h"
 #include "InstancedParticleSystem.h"
-#include "Timer.h"
+#include "Profiler.h"
+#include "ProfilerWindow.h"
+#include "TraceCapture.h"
+#include "Options.h"
+#include "FrameStats.h"
+#include "DynamicResolution.h"
+#include "QualityGovernor.h"
 #include "GaussianBlur.h"
-#include "AdditiveBlend.h"
 #include "Camera.h"
+#include "Scene.h"
+#include "Random.h"
+#include "Recording.h"
+#include "Snapshot.h"
+#include "ParticleExport.h"
+#include "FrameCapture.h"
+#include "ShaderReload.h"
+#include "GLDebug.h"
+#ifdef PARTICLES_HAS_EGL
+#include "HeadlessContext.h"
+#endif
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -22,13 +38,25 @@
 #include <vector>
 #include <algorithm>
 #include <chrono>
+#include <ctime>
+#include <iterator>
+#include <cfloat>
+#include <cstdio>
+#include <optional>
+#include <random>
+#include <utility>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 //void processInput(GLFWwindow* window, SimpleParticleSystem& particleSystem, float t);
 //void processInput(GLFWwindow* window, BatchParticleSystem& particleSystem, float t);
-void processInput(GLFWwindow* window, InstancedParticleSystem& particleSystem, float t);
+void processInput(GLFWwindow* window, InstancedParticleSystem& particleSystem, const QualityGovernor& governor, float t);
+int runHeadless(const Options& options);
+void configureShaderCache(const Options& options);
+gl::ErrorChecks requestedErrorChecks(const Options& options);
+void configureErrorChecks(gl::ErrorChecks requested);
+void reportShaderCache();
 
 // settings
 const unsigned int SCR_WIDTH = 1920;
@@ -43,30 +71,36 @@ auto camera = Camera{};
 float deltaTime = 0.0f;	// time between current frame and last frame
 float lastFrame = 0.0f;
 
-std::vector<float> fpsValues(100);
-std::vector<float> particlesDrawTimes;
+auto frameStats = FrameStats{};
 
 // TODO send help
-InstancedParticleSystem* particleSystemPtr;
-//BatchParticleSystem* particleSystemPtr;
-//SimpleParticleSystem* particleSystemPtr;
-GaussianBlur* gaussianBlurPtr;
-AdditiveBlend* additiveBlendPtr;
+Scene* scenePtr;
+recording::Recorder* recorderPtr = nullptr;
 
-void insertFpsVal(float v)
+int main(int argc, char** argv) try
 {
-    fpsValues.erase(fpsValues.begin());
-    fpsValues.push_back(v);
-}
+    const auto options = Options::parse(argc, argv);
 
-int main() try
-{
-    particlesDrawTimes.resize(1000);
+    if (options.headless)
+        return runHeadless(options);
+
+    // replays always use the recorded seed, recordings need a known one
+    auto replay = std::optional<recording::Replay>{};
+    if (!options.replayPath.empty())
+    {
+        replay.emplace(options.replayPath);
+        rng::seed(replay->seed());
+    }
+    const auto seed = options.seed.value_or(std::random_device{}());
+    if (options.seed || !options.recordPath.empty())
+        rng::seed(seed);
 
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    const auto errorChecks = requestedErrorChecks(options);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, errorChecks == gl::ErrorChecks::Debug);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -89,6 +123,7 @@ int main() try
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    configureErrorChecks(errorChecks);
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
@@ -97,23 +132,48 @@ int main() try
 
     // scope to call glDelete's before glfwTerminate();
     {
-        auto quadTextureShader = Shader("texture.glsl");
-        quadTextureShader.use();
-        quadTextureShader.setInt("sceneTexture", 0);
-
         // TODO has to be after opengl init because constructor uses opengl
-        //auto particleSystem = BatchParticleSystem(500e3);
-        const auto quad = TexturedQuad{};
-        auto particleSystem = InstancedParticleSystem(500e3, CURRENT_WIDTH, CURRENT_HEIGHT);
-        //auto particleSystem = BatchParticleSystem(500e3, CURRENT_WIDTH, CURRENT_HEIGHT);
-        //auto particleSystem = SimpleParticleSystem(500e3, CURRENT_WIDTH, CURRENT_HEIGHT);
-        auto gaussianBlur = GaussianBlur(CURRENT_WIDTH, CURRENT_HEIGHT, quad);
-        auto additiveBlend = AdditiveBlend(CURRENT_WIDTH, CURRENT_HEIGHT, quad);
+        configureShaderCache(options);
+        auto scene = Scene(500e3, CURRENT_WIDTH, CURRENT_HEIGHT);
+        reportShaderCache();
+        auto& particleSystem = scene.particleSystem();
+        auto& gaussianBlur = scene.gaussianBlur();
+        auto& dualFilterBloom = scene.dualFilterBloom();
+        auto& additiveBlend = scene.additiveBlend();
+
+        // edits to the files in assets/ show up while the app runs
+        auto shaderReloader = gl::ShaderReloader{};
+
+        auto frameProfiler = profiler::Profiler{};
+        auto traceCapture = profiler::TraceCapture(frameProfiler);
+        auto dynamicResolution = DynamicResolution{};
+        auto governor = QualityGovernor{};
+        if (!options.tracePath.empty())
+            traceCapture.start(options.tracePath, options.traceFrames);
+
+        auto recorder = std::optional<recording::Recorder>{};
+        if (!options.recordPath.empty())
+            recorder.emplace(options.recordPath, seed, options.fixedDelta);
+
+        auto particleExporter = std::optional<exporter::ParticleExporter>{};
+        if (!options.exportPath.empty())
+            particleExporter.emplace(options.exportPath, options.exportEvery, options.exportQuantize, options.exportDelta);
+        auto exportEvery = static_cast<int>(options.exportEvery);
+        auto exportQuantize = options.exportQuantize, exportDelta = options.exportDelta;
+
+        // interactive capture drops frames when encoding falls behind, use --headless for complete sequences
+        auto frameCapture = std::optional<capture::FrameCapture>{};
+        const auto startCapture = [&](const std::filesystem::path& path)
+        {
+            const auto format = options.captureFormat.empty() ? capture::formatFromPath(path) : capture::parseFormat(options.captureFormat);
+            frameCapture.emplace(path, format, CURRENT_WIDTH, CURRENT_HEIGHT, 60, false);
+        };
+        if (!options.capturePath.empty())
+            startCapture(options.capturePath);
 
         // TODO send help
-        particleSystemPtr = &particleSystem;
-        gaussianBlurPtr = &gaussianBlur;
-        additiveBlendPtr = &additiveBlend;
+        scenePtr = &scene;
+        recorderPtr = recorder ? &*recorder : nullptr;
 
         // Setup Dear ImGui context
         IMGUI_CHECKVERSION();
@@ -129,56 +189,93 @@ int main() try
         ImGui_ImplOpenGL3_Init("#version 330 core");
 
         bool show_demo_window = false;
-        bool blur = true, bloom = true;
-
+        auto& blur = scene.blur();
+        auto& bloom = scene.bloom();
+        int traceFrames = options.traceFrames;
+
+        // sim time is shifted by this after restoring a snapshot, so the restored particles keep their age
+        auto timeOffset = 0.f;
+        auto restorePending = !options.snapshotPath.empty();
+        char snapshotPath[256] = "snapshot.bin";
+        if (restorePending)
+            std::snprintf(snapshotPath, sizeof(snapshotPath), "%s", options.snapshotPath.c_str());
+        auto snapshotStatus = std::string{};
+
+        auto glCalls = gl::CallCounters{}; // of the previous frame, ui included
+
+        auto simFrame = 0u;
+        lastFrame = glfwGetTime();
         while (!glfwWindowShouldClose(window))
         {
             float currentFrame = glfwGetTime();
             deltaTime = currentFrame - lastFrame;
             lastFrame = currentFrame;
 
-            insertFpsVal(1 / deltaTime);
-
-            processInput(window, particleSystem, currentFrame);
-
-            const auto view = camera.view();
-            const auto projection = camera.projection(CURRENT_WIDTH, CURRENT_HEIGHT);
-
-            glEnable(GL_DEPTH_TEST);
+            // the first delta only spans the setup right before the loop
+            if (simFrame > 0)
+                frameStats.add(deltaTime * 1000.f);
 
-            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            shaderReloader.update();
 
-            auto finalTexture = particleSystem.texture();
-            {
-                const auto timer = Timer<std::chrono::milliseconds>(particlesDrawTimes);
-                particleSystem.draw(view, projection, currentFrame);
-            }
+            // simulation time, fixed step when requested so recordings don't depend on the frame rate
+            auto simTime = (options.fixedDelta > 0.f ? simFrame * options.fixedDelta : currentFrame) + timeOffset;
+            simFrame++;
 
-            // blur / bloom
-            if (blur)
+            if (restorePending)
             {
-                gaussianBlur.draw(particleSystem.texture());
-                finalTexture = gaussianBlur.texture();
-
-                if (bloom)
+                restorePending = false;
+                try
                 {
-                    additiveBlend.draw(particleSystem.texture(), gaussianBlur.texture());
-                    finalTexture = additiveBlend.texture();
+                    const auto start = std::chrono::steady_clock::now();
+                    const auto snapshot = snapshot::Snapshot(snapshotPath);
+                    const auto snapshotTime = snapshot::restore(snapshot, particleSystem, camera);
+                    const auto ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                    timeOffset += snapshotTime - simTime;
+                    simTime = snapshotTime;
+                    snapshotStatus = "Restored " + std::to_string(snapshot.particleCount()) + " particles in " + std::to_string(ms) + " ms";
+                    std::cout << snapshotStatus << std::endl;
+                }
+                catch (const std::exception& e)
+                {
+                    // a bad file passed on the command line is fatal, one picked in the ui is not
+                    if (simFrame == 1)
+                        throw;
+                    snapshotStatus = e.what();
                 }
             }
 
+            governor.update(frameProfiler.lastCompleteFrame(), frameStats.budgetMs(), scene);
+            if (replay)
             {
-                quadTextureShader.use();
-                glBindVertexArray(quad.VAO()); gl::checkError();
-                glActiveTexture(GL_TEXTURE0); gl::checkError();
-                glBindTexture(GL_TEXTURE_2D, finalTexture); gl::checkError();
-                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0); gl::checkError();
-                //glUseProgram(0);
-                //gl::checkError();
+                if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS || !replay->nextFrame(particleSystem, camera, simTime))
+                    glfwSetWindowShouldClose(window, true);
             }
+            else
+            {
+                PROFILE_CPU_SCOPE("input");
+                if (recorder)
+                    recorder->properties(particleSystem.props());
+                processInput(window, particleSystem, governor, simTime);
+                if (recorder)
+                    recorder->frame(simTime, camera);
+            }
+
+            const auto view = camera.view();
+            const auto projection = camera.projection(CURRENT_WIDTH, CURRENT_HEIGHT);
+
+            auto capture = Scene::Capture{};
+            if (frameCapture)
+                capture = [&](GLuint texture) { frameCapture->frame(CURRENT_WIDTH, CURRENT_HEIGHT, texture); };
+            scene.renderScale(dynamicResolution.update(frameProfiler.lastCompleteFrame()));
+            scene.draw(view, projection, simTime, capture);
+
+            if (particleExporter)
+                particleExporter->frame(particleSystem, simTime);
 
             {
+                PROFILE_SCOPE("imgui");
+                const auto debugGroup = gl::DebugGroup("imgui");
                 ImGui_ImplOpenGL3_NewFrame();
                 ImGui_ImplGlfw_NewFrame();
                 ImGui::NewFrame();
@@ -204,8 +301,75 @@ int main() try
                 {
                     ImGui::Begin("FPS");
                     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-                    ImGui::PlotLines("", &fpsValues[0], fpsValues.size(), 0, nullptr, 1.f, 144.0f, ImVec2(0, 100.0f));
-                    ImGui::PlotLines("draw [ms]", &particlesDrawTimes[0], particlesDrawTimes.size(), 0, nullptr, 0.f, 16.f, ImVec2(0, 100.f));
+                    const auto& history = frameStats.history();
+                    ImGui::PlotLines("frame [ms]", history.data(), history.size(), history.offset(), nullptr, 0.f, 50.f, ImVec2(0, 100.0f));
+
+                    const auto& allFrames = frameStats.allFrames();
+                    ImGui::Text("p50 %.2f  p95 %.2f  p99 %.2f  max %.2f ms", allFrames.percentile(50.0), allFrames.percentile(95.0), allFrames.percentile(99.0), allFrames.max());
+                    auto budget = static_cast<float>(frameStats.budgetMs());
+                    if (ImGui::SliderFloat("Budget [ms]", &budget, 1.f, 50.f))
+                        frameStats.budgetMs(budget);
+                    ImGui::Text("Frames over budget: %llu / %llu", static_cast<unsigned long long>(frameStats.hitches()), static_cast<unsigned long long>(allFrames.count()));
+                    ImGui::Text("GL calls: %llu uniform lookups, %llu uniforms, %llu buffer uploads, %llu glGetError",
+                        static_cast<unsigned long long>(glCalls.getUniformLocation), static_cast<unsigned long long>(glCalls.uniform),
+                        static_cast<unsigned long long>(glCalls.bufferUpload), static_cast<unsigned long long>(glCalls.getError));
+                    if (glCalls.debugMessages)
+                        ImGui::TextColored(ImVec4(1.f, 0.4f, 0.4f, 1.f), "GL debug messages: %llu (see stderr)", static_cast<unsigned long long>(glCalls.debugMessages));
+                    ImGui::Text("GL state: %llu calls issued, %llu skipped as redundant",
+                        static_cast<unsigned long long>(glCalls.stateIssued), static_cast<unsigned long long>(glCalls.stateSkipped));
+                    const auto& targets = scene.targets();
+                    ImGui::Text("Render targets: %zu (%.1f MB), %zu allocated, %zu resizes", targets.size(), targets.bytes() / 1e6, targets.allocations(), targets.resizes());
+                    const auto& graph = scene.graph();
+                    ImGui::Text("Render graph: %zu passes, %zu culled, %zu merged", graph.executed(), graph.culled(), graph.folded());
+                    ImGui::Checkbox("Dynamic resolution", &dynamicResolution.enabled());
+                    ImGui::SameLine();
+                    ImGui::Text("scale %.2f (%ux%u), GPU %.2f ms", scene.renderScale(), targets.width(), targets.height(), dynamicResolution.gpuMs());
+                    ImGui::BeginDisabled(!dynamicResolution.enabled());
+                    ImGui::SliderFloat("GPU target [ms]", &dynamicResolution.targetMs(), 1.f, 50.f);
+                    ImGui::SliderFloat("Min scale", &dynamicResolution.minScale(), 0.25f, 1.f);
+                    ImGui::EndDisabled();
+                    ImGui::Checkbox("Quality governor", &governor.enabled());
+                    ImGui::SameLine();
+                    ImGui::Text("level %d / %zu", governor.level(), QualityGovernor::LEVELS.size() - 1);
+                    if (!governor.lastDecision().empty())
+                        ImGui::TextWrapped("%s", governor.lastDecision().c_str());
+
+                    auto fromMs = 0.0, toMs = 0.0;
+                    const auto bins = allFrames.bins<32>(fromMs, toMs);
+                    char histogramLabel[64];
+                    std::snprintf(histogramLabel, sizeof(histogramLabel), "%.2f - %.2f ms (log)", fromMs, toMs);
+                    ImGui::PlotHistogram("", bins.data(), static_cast<int>(bins.size()), 0, histogramLabel, 0.f, FLT_MAX, ImVec2(0, 80.0f));
+
+                    ImGui::BeginDisabled(traceCapture.capturing());
+                    ImGui::InputInt("Trace frames", &traceFrames);
+                    if (ImGui::Button("Capture trace"))
+                        traceCapture.start("trace_" + std::to_string(std::time(nullptr)) + ".json", traceFrames);
+                    ImGui::EndDisabled();
+                    if (traceCapture.capturing())
+                        ImGui::Text("Capturing %s, %d frames left", traceCapture.path().c_str(), traceCapture.remainingFrames());
+                    else if (traceCapture.writtenFrames())
+                        ImGui::Text("Wrote %zu frames to %s (%zu dropped)", traceCapture.writtenFrames(), traceCapture.path().c_str(), traceCapture.droppedFrames());
+
+                    if (!frameCapture && ImGui::Button("Capture video"))
+                        startCapture("capture_" + std::to_string(std::time(nullptr)) + ".y4m");
+                    else if (frameCapture && ImGui::Button("Stop capture"))
+                        frameCapture.reset();
+                    if (frameCapture)
+                        ImGui::Text("%s: %zu frames written, %zu pending, %zu dropped", frameCapture->output().string().c_str(), frameCapture->written(), frameCapture->pending(), frameCapture->dropped());
+                    ImGui::End();
+                }
+
+                profiler::showWindow(frameProfiler);
+
+                // compile errors of reloaded shaders, the last good program keeps running meanwhile
+                if (!shaderReloader.errors().empty())
+                {
+                    ImGui::Begin("Shader errors");
+                    for (const auto& [shader, error] : shaderReloader.errors())
+                    {
+                        ImGui::TextColored(ImVec4(1.f, 0.4f, 0.4f, 1.f), "%s", error.shader.c_str());
+                        ImGui::TextUnformatted(error.log.c_str());
+                    }
                     ImGui::End();
                 }
 
@@ -245,15 +409,105 @@ int main() try
                     ImGui::SliderInt("Life time [s]", &particleSystem.totalLifetimeSeconds(), 0, 100);
                     ImGui::RadioButton("Square", &particleSystem.particleShape(), 0); ImGui::SameLine(); ImGui::RadioButton("Circle", &particleSystem.particleShape(), 1); ImGui::SameLine(); ImGui::RadioButton("Triangle", &particleSystem.particleShape(), 2);
                     ImGui::SliderFloat("Thickness", &particleSystem.shapeThickness(), 0.0f, 1.f);
+                    ImGui::Checkbox("Antialiased edges", &particleSystem.antialias());
+                    auto instanceFormat = static_cast<int>(particleSystem.instanceFormat());
+                    ImGui::RadioButton("Compact instances", &instanceFormat, 0); ImGui::SameLine(); ImGui::RadioButton("Matrix instances", &instanceFormat, 1);
+                    particleSystem.instanceFormat() = static_cast<InstancedParticleSystem::InstanceFormat>(instanceFormat);
+                    ImGui::BeginDisabled(particleSystem.instanceFormat() != InstancedParticleSystem::InstanceFormat::Compact);
+                    ImGui::SliderFloat("Point sprites below [px]", &particleSystem.pointSpritesBelow(), 0.f, 32.f);
+                    ImGui::EndDisabled();
+                    ImGui::Text("Largest particle %.1f px, drawn as %s", particleSystem.projectedSize(), particleSystem.pointSprites() ? "points" : "quads");
+                    ImGui::Text("Shader variants compiled: %zu", particleSystem.compiledVariants());
 
-                    ImGui::Checkbox("Gaussian blur", &blur);
+                    ImGui::Checkbox("Blur", &blur);
                     ImGui::BeginDisabled(!blur);
-                    ImGui::SliderInt("Iterations", &gaussianBlur.iterations(), 1, 20);
+                    auto blurFilter = static_cast<int>(scene.blurFilter());
+                    ImGui::RadioButton("Gaussian", &blurFilter, 0); ImGui::SameLine(); ImGui::RadioButton("Dual filter", &blurFilter, 1);
+                    scene.blurFilter() = static_cast<Scene::BlurFilter>(blurFilter);
+                    if (scene.blurFilter() == Scene::BlurFilter::Gaussian)
+                    {
+                        ImGui::SliderFloat("Sigma", &gaussianBlur.sigma(), 0.5f, 20.f);
+                        ImGui::BeginDisabled(!gaussianBlur.computeAvailable());
+                        ImGui::Checkbox("Compute shader", &gaussianBlur.compute());
+                        ImGui::SameLine();
+                        if (ImGui::Button("Verify"))
+                            scene.verifyBlur();
+                        ImGui::EndDisabled();
+                        if (gaussianBlur.usesCompute(scene.colorFormat()))
+                            ImGui::Text("1 dispatch, tile + apron in shared memory");
+                        else
+                            ImGui::Text("%d texture fetches per pixel and pass", gaussianBlur.fetches());
+                        if (scene.blurDifference() >= 0.f)
+                            ImGui::Text("Compute vs fragment: max difference %.4f", scene.blurDifference());
+                    }
+                    else
+                    {
+                        ImGui::SliderInt("Levels", &dualFilterBloom.levels(), 1, DualFilterBloom::MAX_LEVELS);
+                        ImGui::SliderFloat("Threshold", &dualFilterBloom.threshold(), 0.f, 1.f);
+                    }
+                    ImGui::Checkbox("Compare filters", &scene.compareFilters());
+                    if (const auto* frame = frameProfiler.lastCompleteFrame(); frame && scene.compareFilters())
+                        ImGui::Text("GPU: gaussian %.3f ms, dual filter %.3f ms", frame->gpuMs("gaussian blur"), frame->gpuMs("dual filter bloom"));
                     ImGui::Checkbox("Bloom", &bloom);
                     ImGui::BeginDisabled(!bloom);
                     ImGui::SliderFloat("Factor", &additiveBlend.factor(), 0.0f, 10.f);
                     ImGui::EndDisabled();
                     ImGui::EndDisabled();
+                    ImGui::Checkbox("Merge full-screen passes", &scene.graph().merge());
+
+                    // 4 bytes per pixel either way for rgb8 and r11f_g11f_b10f, rgba16f doubles the bandwidth
+                    constexpr GLenum COLOR_FORMATS[] = { GL_RGB8, GL_R11F_G11F_B10F, GL_RGBA16F };
+                    auto colorFormat = static_cast<int>(std::find(std::begin(COLOR_FORMATS), std::end(COLOR_FORMATS), scene.colorFormat()) - std::begin(COLOR_FORMATS));
+                    ImGui::RadioButton("RGB8", &colorFormat, 0); ImGui::SameLine(); ImGui::RadioButton("R11G11B10F", &colorFormat, 1); ImGui::SameLine(); ImGui::RadioButton("RGBA16F", &colorFormat, 2);
+                    scene.colorFormat() = COLOR_FORMATS[colorFormat];
+                    auto& tonemap = scene.tonemap();
+                    auto tonemapOperator = static_cast<int>(tonemap.op());
+                    ImGui::Text("Tonemap"); ImGui::SameLine();
+                    ImGui::RadioButton("None", &tonemapOperator, 0); ImGui::SameLine(); ImGui::RadioButton("Reinhard", &tonemapOperator, 1); ImGui::SameLine(); ImGui::RadioButton("ACES", &tonemapOperator, 2);
+                    tonemap.op() = static_cast<Tonemap::Operator>(tonemapOperator);
+                    ImGui::BeginDisabled(tonemap.op() == Tonemap::Operator::None);
+                    ImGui::SliderFloat("Exposure", &tonemap.exposure(), 0.1f, 8.f);
+                    ImGui::EndDisabled();
+
+                    // snapshots would desync a recording or replay
+                    ImGui::BeginDisabled(replay.has_value() || recorder.has_value());
+                    ImGui::InputText("Snapshot", snapshotPath, sizeof(snapshotPath));
+                    if (ImGui::Button("Save snapshot"))
+                    {
+                        try
+                        {
+                            const auto start = std::chrono::steady_clock::now();
+                            snapshot::save(snapshotPath, particleSystem, camera, simTime);
+                            const auto ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+                            snapshotStatus = "Saved " + std::to_string(particleSystem.aliveParticlesCount()) + " particles in " + std::to_string(ms) + " ms";
+                        }
+                        catch (const std::exception& e)
+                        {
+                            snapshotStatus = e.what();
+                        }
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Load snapshot"))
+                        restorePending = true;
+                    ImGui::EndDisabled();
+                    if (!snapshotStatus.empty())
+                        ImGui::Text("%s", snapshotStatus.c_str());
+
+                    ImGui::BeginDisabled(particleExporter.has_value());
+                    ImGui::SliderInt("Export every", &exportEvery, 1, 60);
+                    ImGui::Checkbox("Quantize", &exportQuantize);
+                    ImGui::SameLine();
+                    ImGui::Checkbox("Delta", &exportDelta);
+                    ImGui::EndDisabled();
+                    if (!particleExporter && ImGui::Button("Start export"))
+                    {
+                        exportQuantize |= exportDelta;
+                        particleExporter.emplace("particles_" + std::to_string(std::time(nullptr)) + ".pexp", exportEvery, exportQuantize, exportDelta);
+                    }
+                    else if (particleExporter && ImGui::Button("Stop export"))
+                        particleExporter.reset();
+                    if (particleExporter)
+                        ImGui::Text("Exported %zu frames, %.1f MB, %zu dropped, last %.2f ms", particleExporter->exported(), particleExporter->bytes() / 1e6, particleExporter->dropped(), particleExporter->encodeMs());
 
                     ImGui::End();
                 }
@@ -262,10 +516,22 @@ int main() try
                 ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
             }
 
+            gl::checkFrameErrors();
+            frameProfiler.endFrame();
+            glCalls = std::exchange(gl::counters(), gl::CallCounters{});
+
             glfwSwapBuffers(window);
             glfwPollEvents();
         }
 
+        frameStats.print(std::cout);
+
+        if (recorder)
+            recorder->finish(particleSystem.stateHash());
+
+        if (replay && replay->expectedHash())
+            std::cout << "Replay " << (*replay->expectedHash() == particleSystem.stateHash() ? "matches" : "does NOT match") << " the recording" << std::endl;
+
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
@@ -281,7 +547,7 @@ catch (const std::exception& e)
 }
 
 //void processInput(GLFWwindow* window, BatchParticleSystem& particleSystem, float t)
-void processInput(GLFWwindow* window, InstancedParticleSystem& particleSystem, float t)
+void processInput(GLFWwindow* window, InstancedParticleSystem& particleSystem, const QualityGovernor& governor, float t)
 //void processInput(GLFWwindow* window, SimpleParticleSystem& particleSystem, float t)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -310,23 +576,160 @@ void processInput(GLFWwindow* window, InstancedParticleSystem& particleSystem, f
 
         auto worldPos = camera.position() + offsetFromCamera;
         {
-            if (ImGui::GetIO().Framerate > 59.f)
+            if (const auto spawnCount = governor.spawnCount(particleSystem.spawnCount()); spawnCount > 0)
+            {
+                // emitted and recorded with the governed count, the slider keeps the requested one
+                const auto requested = std::exchange(particleSystem.spawnCount(), spawnCount);
+                if (recorderPtr)
+                    recorderPtr->properties(particleSystem.props());
                 particleSystem.emit(worldPos, t);
+                if (recorderPtr)
+                    recorderPtr->emit(worldPos, t);
+                particleSystem.spawnCount() = requested;
+            }
         }
     }
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-    // make sure the viewport matches the new window dimensions; note that width and 
+    // the viewport and the render targets follow at the start of the next frame; note that width and
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
     CURRENT_WIDTH = width;
     CURRENT_HEIGHT = height;
 
-    particleSystemPtr->resize(width, height);
-    gaussianBlurPtr->resize(width, height);
-    additiveBlendPtr->resize(width, height);
+    scenePtr->resize(width, height);
+}
+
+// Replays a recording as fast as possible without a window, then checks the final particle state against the recording.
+int runHeadless(const Options& options)
+{
+#ifdef PARTICLES_HAS_EGL
+    if (options.replayPath.empty())
+        throw std::runtime_error("--headless needs --replay");
+
+    const auto width = options.width ? options.width : SCR_WIDTH;
+    const auto height = options.height ? options.height : SCR_HEIGHT;
+
+    const auto errorChecks = requestedErrorChecks(options);
+    auto context = HeadlessContext(width, height, errorChecks == gl::ErrorChecks::Debug);
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+    configureErrorChecks(errorChecks);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glViewport(0, 0, width, height);
+
+    auto replay = recording::Replay(options.replayPath);
+    rng::seed(replay.seed());
+
+    auto matches = true;
+    {
+        configureShaderCache(options);
+        auto scene = Scene(500e3, width, height);
+        reportShaderCache();
+        auto frameProfiler = profiler::Profiler{};
+        auto traceCapture = profiler::TraceCapture(frameProfiler);
+        if (!options.tracePath.empty())
+            traceCapture.start(options.tracePath, options.traceFrames);
+
+        auto particleExporter = std::optional<exporter::ParticleExporter>{};
+        if (!options.exportPath.empty())
+            particleExporter.emplace(options.exportPath, options.exportEvery, options.exportQuantize, options.exportDelta);
+
+        // offline capture keeps every frame, at the recording's fixed step (or 60 fps for wall clock recordings)
+        auto frameCapture = std::optional<capture::FrameCapture>{};
+        if (!options.capturePath.empty())
+        {
+            const auto format = options.captureFormat.empty() ? capture::formatFromPath(options.capturePath) : capture::parseFormat(options.captureFormat);
+            const auto fps = replay.fixedDelta() > 0.f ? static_cast<unsigned int>(1.f / replay.fixedDelta() + 0.5f) : 60u;
+            frameCapture.emplace(options.capturePath, format, width, height, fps, true);
+        }
+
+        auto replayCamera = Camera{};
+        auto simTime = 0.f;
+        const auto start = std::chrono::steady_clock::now();
+        auto frameStart = start;
+        while (replay.nextFrame(scene.particleSystem(), replayCamera, simTime))
+        {
+            auto capture = Scene::Capture{};
+            if (frameCapture)
+                capture = [&](GLuint texture) { frameCapture->frame(width, height, texture); };
+            scene.draw(replayCamera.view(), replayCamera.projection(width, height), simTime, capture);
+            if (particleExporter)
+                particleExporter->frame(scene.particleSystem(), simTime);
+            gl::checkFrameErrors();
+            frameProfiler.endFrame();
+            context.swapBuffers();
+
+            const auto now = std::chrono::steady_clock::now();
+            frameStats.add(std::chrono::duration<float, std::milli>(now - frameStart).count());
+            frameStart = now;
+        }
+        glFinish();
+        if (frameCapture)
+            frameCapture->finish();
+
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Replayed " << replay.frames() << " frames in " << seconds << " s (" << replay.frames() / seconds << " FPS)" << std::endl;
+        if (frameCapture)
+            std::cout << "Captured " << frameCapture->written() << " frames to " << frameCapture->output().string() << std::endl;
+        frameStats.print(std::cout);
+
+        const auto hash = scene.particleSystem().stateHash();
+        if (replay.expectedHash())
+        {
+            matches = *replay.expectedHash() == hash;
+            std::cout << "Replay " << (matches ? "matches" : "does NOT match") << " the recording (state hash " << std::hex << hash << std::dec << ")" << std::endl;
+        }
+    }
+
+    return matches ? EXIT_SUCCESS : EXIT_FAILURE;
+#else
+    throw std::runtime_error("This build has no headless (EGL) support");
+#endif
+}
+
+void configureShaderCache(const Options& options)
+{
+    if (!options.assetsPath.empty())
+        assets::looseDirectory() = std::filesystem::path(options.assetsPath);
+    if (const auto& directory = assets::looseDirectory())
+        std::cout << "Assets: loose files in " << directory->string() << std::endl;
+    else if (assets::embeddedCount())
+        std::cout << "Assets: " << assets::embeddedCount() << " embedded (--assets DIR to edit them live)" << std::endl;
+
+    auto& cache = gl::ProgramCache::get();
+    cache.enabled(!options.shaderCache.empty());
+    if (!options.shaderCache.empty())
+        cache.directory(options.shaderCache);
+}
+
+// debug builds default to the KHR_debug callback, release builds do not check
+gl::ErrorChecks requestedErrorChecks(const Options& options)
+{
+    if (!options.glErrors.empty())
+        return gl::parseErrorChecks(options.glErrors);
+#ifdef NDEBUG
+    return gl::ErrorChecks::Off;
+#else
+    return gl::ErrorChecks::Debug;
+#endif
+}
+
+void configureErrorChecks(gl::ErrorChecks requested)
+{
+    if (gl::enableErrorChecks(requested) != requested)
+        std::cout << "KHR_debug is not available (GL " << glGetString(GL_VERSION) << "), checking GL errors after every call" << std::endl;
+}
+
+void reportShaderCache()
+{
+    const auto& cache = gl::ProgramCache::get();
+    std::printf("Shader programs: %zu from cache in %.1f ms, %zu compiled in %.1f ms, %zu rejected, ~%.1f ms saved\n",
+        cache.loaded(), cache.loadMs(), cache.compiled(), cache.compileMs(), cache.rejected(), cache.savedMs());
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)